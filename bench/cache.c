@@ -0,0 +1,210 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "htfh.h"
+#include "allocator_errno.h"
+
+/*
+** Cache behaviour of malloc and free.
+**
+** A pseudo-random workload of small, mixed lifetime allocations runs
+** against a fresh heap while hardware counters read L1 data cache and
+** last-level cache misses, the levels the generic perf events expose.
+** Between operations an optional sweep over a buffer evicts the
+** allocator's state, so the misses of a cold call can be compared with
+** those of back-to-back calls. Reported per operation: nanoseconds and
+** misses of each counter, or n/a where the counters are unavailable.
+** The cache lines the controller's free list state spans are printed
+** first.
+**
+** Usage: htfh_bench_cache [operations] [evict bytes]
+*/
+
+#define DEFAULT_OPERATIONS 2000000
+#define HEAP_SIZE (64 * 1024 * 1024)
+#define SLOT_COUNT 8192
+#define LINE_SIZE 64
+
+enum counter {
+    COUNTER_L1D,
+    COUNTER_LLC,
+    COUNTER_COUNT,
+};
+
+typedef struct Counters {
+    int fd[COUNTER_COUNT];
+    uint64_t total[COUNTER_COUNT];
+} Counters;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/* Consumes the eviction sweep so it is not optimised away. */
+static volatile unsigned int sink;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int counter_open(uint64_t cache) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void counters_start(Counters* counters) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters->fd[i] != -1) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void counters_stop(Counters* counters) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        uint64_t value = 0;
+        if (counters->fd[i] != -1) {
+            ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters->fd[i], &value, sizeof(value)) == sizeof(value)) {
+                counters->total[i] += value;
+            }
+        }
+    }
+}
+
+static void print_layout(void) {
+    printf("controller: %zu bytes, %zu cache lines\n", sizeof(Controller), (sizeof(Controller) + LINE_SIZE - 1) / LINE_SIZE);
+    printf("  %-20s %6s %8s\n", "field", "offset", "lines");
+#define PRINT_FIELD(field) printf( \
+        "  %-20s %6zu %4zu-%zu\n", \
+        #field, \
+        offsetof(Controller, field), \
+        offsetof(Controller, field) / LINE_SIZE, \
+        (offsetof(Controller, field) + sizeof(((Controller*) NULL)->field) - 1) / LINE_SIZE \
+    )
+    PRINT_FIELD(block_null);
+    PRINT_FIELD(fl_bitmap);
+    PRINT_FIELD(sl_bitmap);
+    PRINT_FIELD(fit_policy);
+    PRINT_FIELD(deferred_coalescing);
+    PRINT_FIELD(generation);
+    PRINT_FIELD(free_bytes);
+    PRINT_FIELD(blocks);
+    PRINT_FIELD(quick_count);
+    PRINT_FIELD(quick);
+    PRINT_FIELD(absorbed);
+#undef PRINT_FIELD
+    /* Lines of the state read or written by every malloc and free, one blocks entry aside. */
+    unsigned long long hot = 0;
+#define MARK_FIELD(field) for ( \
+        size_t line = offsetof(Controller, field) / LINE_SIZE; \
+        line <= (offsetof(Controller, field) + sizeof(((Controller*) NULL)->field) - 1) / LINE_SIZE; \
+        line++ \
+    ) hot |= 1ULL << (line % 64)
+    MARK_FIELD(block_null);
+    MARK_FIELD(fl_bitmap);
+    MARK_FIELD(sl_bitmap);
+    MARK_FIELD(fit_policy);
+    MARK_FIELD(deferred_coalescing);
+    MARK_FIELD(generation);
+    MARK_FIELD(free_bytes);
+#undef MARK_FIELD
+    printf("hot controller lines: %d, plus one per free list head\n", __builtin_popcountll(hot));
+    printf("allocator: %zu bytes, mutex at offset %zu\n\n", sizeof(Allocator), offsetof(Allocator, mutex));
+}
+
+static void print_counter(const char* name, const Counters* counters, int counter, size_t operations) {
+    if (counters->fd[counter] == -1) {
+        printf("  %-10s %10s\n", name, "n/a");
+    } else {
+        printf("  %-10s %10.3f\n", name, (double) counters->total[counter] / (double) operations);
+    }
+}
+
+static void run(const char* name, size_t operations, volatile unsigned char* evict, size_t evict_bytes) {
+    Allocator* alloc = htfh_create(HEAP_SIZE);
+    void** slots = calloc(SLOT_COUNT, sizeof(*slots));
+    if (alloc == NULL || slots == NULL) {
+        alloc_perror("Unable to create allocator: ");
+        exit(1);
+    }
+    Counters counters = { { counter_open(PERF_COUNT_HW_CACHE_L1D), counter_open(PERF_COUNT_HW_CACHE_LL) }, { 0, 0 } };
+    rng_state = 0x9E3779B97F4A7C15ULL;
+    uint64_t elapsed = 0;
+    unsigned int sum = 0;
+    for (size_t i = 0; i < operations; i++) {
+        const uint64_t r = rng_next();
+        const size_t slot = r % SLOT_COUNT;
+        for (size_t j = 0; j < evict_bytes; j += LINE_SIZE) {
+            sum += evict[j]++;
+        }
+        counters_start(&counters);
+        const uint64_t start = now_ns();
+        if (slots[slot] != NULL) {
+            htfh_free(alloc, slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            slots[slot] = htfh_malloc(alloc, 16 + (r >> 16) % 1024);
+        }
+        elapsed += now_ns() - start;
+        counters_stop(&counters);
+    }
+    sink = sum;
+    printf("%s\n", name);
+    printf("  %-10s %10.1f\n", "ns", (double) elapsed / (double) operations);
+    print_counter("L1D miss", &counters, COUNTER_L1D, operations);
+    print_counter("LLC miss", &counters, COUNTER_LLC, operations);
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (counters.fd[i] != -1) {
+            close(counters.fd[i]);
+        }
+    }
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        htfh_free(alloc, slots[i]);
+    }
+    free(slots);
+    htfh_destroy(alloc);
+}
+
+int main(int argc, char* argv[]) {
+    const size_t operations = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_OPERATIONS;
+    const size_t evict_bytes = argc > 2 ? strtoull(argv[2], NULL, 0) : 256 * 1024;
+    volatile unsigned char* evict = calloc(evict_bytes ? evict_bytes : 1, 1);
+    if (evict == NULL) {
+        return 1;
+    }
+    print_layout();
+    printf("operations: %zu, malloc and free mixed, per operation:\n", operations);
+    run("warm", operations, evict, 0);
+    run("evicted", operations / 16, evict, evict_bytes);
+    free((void*) evict);
+    return 0;
+}
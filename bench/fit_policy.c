@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "htfh.h"
+#include "allocator_errno.h"
+
+/*
+** Fragmentation versus latency of the free block selection policies.
+**
+** Every policy replays the same pseudo-random workload of mixed sized,
+** mixed lifetime allocations against a fresh heap. Reported per policy:
+** - mean/worst malloc and mean free latency in nanoseconds
+** - number of allocations failing with HEAP_FULL
+** - free block count and external fragmentation at the end of the run,
+**   defined as 1 - largest free block / total free bytes
+**
+** Usage: htfh_bench_fit_policy [heap bytes] [operations] [live slots]
+*/
+
+#define DEFAULT_HEAP_SIZE (96 * 1024 * 1024)
+#define DEFAULT_OPERATIONS 2000000
+#define DEFAULT_SLOTS 16384
+
+typedef struct FreeStats {
+    size_t free_bytes;
+    size_t largest_free;
+    size_t free_blocks;
+} FreeStats;
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    /* xorshift64*, deterministic across policies. */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static size_t random_size(void) {
+    const uint64_t r = rng_next();
+    switch (r % 16) {
+        case 15: return 16384 + (r >> 8) % (256 * 1024);
+        case 13: case 14: return 256 + (r >> 8) % 4096;
+        default: return 16 + (r >> 8) % 256;
+    }
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void free_stats_walker(void* ptr, size_t size, int used, void* user) {
+    FreeStats* stats = user;
+    (void) ptr;
+    if (used) {
+        return;
+    }
+    stats->free_bytes += size;
+    stats->free_blocks++;
+    if (size > stats->largest_free) {
+        stats->largest_free = size;
+    }
+}
+
+static int run_policy(const char* name, unsigned int policy, size_t heap_size, size_t operations, size_t slot_count) {
+    Allocator* alloc = htfh_create(heap_size);
+    if (alloc == NULL) {
+        alloc_perror("Unable to create allocator: ");
+        return -1;
+    } else if (htfh_set_fit_policy(alloc, policy) != 0) {
+        alloc_perror("Unable to set fit policy: ");
+        return -1;
+    }
+    void** slots = calloc(slot_count, sizeof(*slots));
+    if (slots == NULL) {
+        return -1;
+    }
+    rng_state = 0x9E3779B97F4A7C15ULL;
+
+    uint64_t malloc_ns = 0, malloc_max_ns = 0, free_ns = 0;
+    size_t mallocs = 0, frees = 0, failures = 0;
+    for (size_t i = 0; i < operations; i++) {
+        const size_t slot = rng_next() % slot_count;
+        if (slots[slot] != NULL) {
+            const uint64_t start = now_ns();
+            htfh_free(alloc, slots[slot]);
+            free_ns += now_ns() - start;
+            frees++;
+            slots[slot] = NULL;
+            continue;
+        }
+        const size_t size = random_size();
+        const uint64_t start = now_ns();
+        slots[slot] = htfh_malloc(alloc, size);
+        const uint64_t elapsed = now_ns() - start;
+        malloc_ns += elapsed;
+        malloc_max_ns = elapsed > malloc_max_ns ? elapsed : malloc_max_ns;
+        mallocs++;
+        if (slots[slot] == NULL) {
+            failures++;
+        }
+    }
+
+    FreeStats stats = { 0, 0, 0 };
+    htfh_walk_pool((char*) alloc->heap + htfh_size(), free_stats_walker, &stats);
+    const double fragmentation = stats.free_bytes
+        ? 1.0 - (double) stats.largest_free / (double) stats.free_bytes
+        : 0.0;
+    printf(
+        "%-28s %10.1f %10llu %10.1f %10zu %10zu %9.2f%%\n",
+        name,
+        mallocs ? (double) malloc_ns / (double) mallocs : 0.0,
+        (unsigned long long) malloc_max_ns,
+        frees ? (double) free_ns / (double) frees : 0.0,
+        failures,
+        stats.free_blocks,
+        fragmentation * 100.0
+    );
+
+    for (size_t i = 0; i < slot_count; i++) {
+        htfh_free(alloc, slots[i]);
+    }
+    free(slots);
+    return htfh_destroy(alloc);
+}
+
+int main(int argc, char* argv[]) {
+    const size_t heap_size = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_HEAP_SIZE;
+    const size_t operations = argc > 2 ? strtoull(argv[2], NULL, 0) : DEFAULT_OPERATIONS;
+    const size_t slot_count = argc > 3 ? strtoull(argv[3], NULL, 0) : DEFAULT_SLOTS;
+
+    printf("heap: %zu bytes, operations: %zu, live slots: %zu\n\n", heap_size, operations, slot_count);
+    printf(
+        "%-28s %10s %10s %10s %10s %10s %10s\n",
+        "policy", "malloc ns", "max ns", "free ns", "HEAP_FULL", "free blks", "frag"
+    );
+    int status = 0;
+    status |= run_policy("good-fit", FIT_GOOD, heap_size, operations, slot_count);
+    status |= run_policy("best-fit in class", FIT_BEST_IN_CLASS, heap_size, operations, slot_count);
+    status |= run_policy("address-ordered good-fit", FIT_ADDRESS_ORDERED, heap_size, operations, slot_count);
+    status |= run_policy("address-ordered best-fit", FIT_BEST_IN_CLASS | FIT_ADDRESS_ORDERED, heap_size, operations, slot_count);
+    return status == 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "htfh.h"
+#include "utils.h"
+#include "controller.h"
+#include "allocator_errno.h"
+
+/*
+** Cost of the size class mapping and bitmap search primitives in isolation.
+**
+** Each primitive is run over the same precomputed pseudo-random inputs,
+** once for sizes covered by the mapping tables and once for larger sizes,
+** alongside the bit-scan mapping the tables replace. Bitmap searches run
+** against the free lists of a heap fragmented by a random workload.
+** Reported per primitive: mean nanoseconds per call, including the input
+** load and the loop.
+**
+** Usage: htfh_bench_mapping [iterations]
+*/
+
+#define DEFAULT_ITERATIONS 50000000
+/* Inputs cycled through, a power of two. */
+#define INPUT_COUNT 4096
+#define HEAP_SIZE (16 * 1024 * 1024)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static size_t small_sizes[INPUT_COUNT];
+static size_t large_sizes[INPUT_COUNT];
+static unsigned int words[INPUT_COUNT];
+static int classes[INPUT_COUNT][2];
+
+/* Consumed after every loop so the calls are not optimised away. */
+static volatile int sink;
+
+static void report(const char* name, uint64_t elapsed, size_t iterations) {
+    printf("%-32s %8.2f\n", name, (double) elapsed / (double) iterations);
+}
+
+#define BENCH_MAPPING(name, function, inputs, iterations) do { \
+    int fl = 0; \
+    int sl = 0; \
+    int acc = 0; \
+    const uint64_t start = now_ns(); \
+    for (size_t i = 0; i < (iterations); i++) { \
+        function((inputs)[i & (INPUT_COUNT - 1)], &fl, &sl); \
+        acc += fl ^ sl; \
+    } \
+    report(name, now_ns() - start, iterations); \
+    sink = acc; \
+} while (0)
+
+#define BENCH_BITSCAN(name, function, iterations) do { \
+    int acc = 0; \
+    const uint64_t start = now_ns(); \
+    for (size_t i = 0; i < (iterations); i++) { \
+        acc += function(words[i & (INPUT_COUNT - 1)]); \
+    } \
+    report(name, now_ns() - start, iterations); \
+    sink = acc; \
+} while (0)
+
+static int fragment_heap(Allocator* alloc) {
+    void* slots[2048] = { NULL };
+    for (size_t i = 0; i < 200000; i++) {
+        const uint64_t r = rng_next();
+        const size_t slot = r % 2048;
+        if (slots[slot] != NULL) {
+            htfh_free(alloc, slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            slots[slot] = htfh_malloc(alloc, 16 + (r >> 16) % ((r & 0x100) ? 64 * 1024 : 1024));
+        }
+    }
+    /* Leave every other block allocated so the free lists stay populated. */
+    for (size_t i = 0; i < 2048; i += 2) {
+        if (slots[i] != NULL && htfh_free(alloc, slots[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    const size_t iterations = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+    Allocator* alloc = htfh_create(HEAP_SIZE);
+    if (alloc == NULL) {
+        alloc_perror("Unable to create allocator: ");
+        return 1;
+    } else if (fragment_heap(alloc) != 0) {
+        alloc_perror("Unable to fragment heap: ");
+        return 1;
+    }
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+        const uint64_t r = rng_next();
+        small_sizes[i] = align_up(r % (MAPPING_TABLE_SIZE_MAX - ALIGN_SIZE), ALIGN_SIZE);
+        large_sizes[i] = align_up(MAPPING_TABLE_SIZE_MAX + (r >> 8) % (HEAP_SIZE - MAPPING_TABLE_SIZE_MAX), ALIGN_SIZE);
+        words[i] = (unsigned int) (r >> 16) | 1U;
+        mapping_search(htfh_block_size_min() + (r >> 24) % (64 * 1024), &classes[i][0], &classes[i][1]);
+    }
+
+    printf("iterations: %zu, table sizes below %d bytes\n\n", iterations, (int) MAPPING_TABLE_SIZE_MAX);
+    printf("%-32s %8s\n", "primitive", "ns/call");
+    BENCH_MAPPING("mapping_insert (table)", mapping_insert, small_sizes, iterations);
+    BENCH_MAPPING("mapping_insert_scan (small)", mapping_insert_scan, small_sizes, iterations);
+    BENCH_MAPPING("mapping_insert (large)", mapping_insert, large_sizes, iterations);
+    BENCH_MAPPING("mapping_search (table)", mapping_search, small_sizes, iterations);
+    BENCH_MAPPING("mapping_search_scan (small)", mapping_search_scan, small_sizes, iterations);
+    BENCH_MAPPING("mapping_search (large)", mapping_search, large_sizes, iterations);
+    BENCH_BITSCAN("htfh_ffs", htfh_ffs, iterations);
+    BENCH_BITSCAN("htfh_fls", htfh_fls, iterations);
+
+    Controller* control = alloc->controller;
+    int acc = 0;
+    const uint64_t start = now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        int fl = classes[i & (INPUT_COUNT - 1)][0];
+        int sl = classes[i & (INPUT_COUNT - 1)][1];
+        acc += controller_search_suitable_block(control, &fl, &sl) != NULL;
+    }
+    report("controller_search_suitable_block", now_ns() - start, iterations);
+    sink = acc;
+    return htfh_destroy(alloc) == 0 ? 0 : 1;
+}
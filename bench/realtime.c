@@ -0,0 +1,186 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include "htfh.h"
+#include "allocator_errno.h"
+
+/*
+** Worst-case latency of malloc and free on a fresh heap, with and without
+** HTFH_CREATE_REALTIME.
+**
+** A pseudo-random workload of mixed size, mixed lifetime allocations
+** walks through the whole heap, so a default heap takes its page faults
+** inside the timed calls while a realtime heap should take none. Every
+** call is timed on its own. The measuring thread asks for SCHED_FIFO,
+** which needs privileges, and runs at its normal priority otherwise.
+** Reported per heap: creation time, page faults taken during the
+** workload, mean, 99.99th percentile and worst latency in nanoseconds,
+** and calls over the bound.
+**
+** Exits with 1 if the realtime heap took a page fault, or if its latency
+** exceeded the bound. Only with SCHED_FIFO is the worst call checked;
+** without it preemption by other tasks dominates the worst of millions of
+** calls, so the 99.99th percentile is checked instead.
+**
+** Usage: htfh_bench_realtime [operations] [bound ns] [heap bytes]
+*/
+
+#define DEFAULT_OPERATIONS 2000000
+#define DEFAULT_BOUND_NS 50000
+#define DEFAULT_HEAP_SIZE (256 * 1024 * 1024)
+#define SLOT_COUNT 16384
+#define SIZE_MAX_REQUEST (32 * 1024)
+
+typedef struct RunResult {
+    uint64_t create_ns;
+    long faults;
+    double mean_ns;
+    uint32_t tail_ns;
+    uint32_t worst_ns;
+    size_t over_bound;
+    size_t failures;
+} RunResult;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static long minor_faults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    const uint32_t x = *(const uint32_t*) a;
+    const uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static int run(unsigned int flags, size_t operations, uint64_t bound, size_t heap_size, uint32_t* samples, RunResult* result) {
+    void* slots[SLOT_COUNT] = { NULL };
+    memset(result, 0, sizeof(*result));
+    const uint64_t start = now_ns();
+    Allocator* alloc = htfh_create_flags(heap_size, flags);
+    result->create_ns = now_ns() - start;
+    if (alloc == NULL) {
+        return -1;
+    }
+    rng_state = 0x9E3779B97F4A7C15ULL;
+    uint64_t total = 0;
+    const long faults = minor_faults();
+    for (size_t i = 0; i < operations; i++) {
+        const uint64_t r = rng_next();
+        const size_t slot = r % SLOT_COUNT;
+        const uint64_t op_start = now_ns();
+        if (slots[slot] != NULL) {
+            htfh_free(alloc, slots[slot]);
+            slots[slot] = NULL;
+        } else {
+            slots[slot] = htfh_malloc(alloc, 16 + (r >> 16) % SIZE_MAX_REQUEST);
+            result->failures += slots[slot] == NULL;
+        }
+        const uint64_t elapsed = now_ns() - op_start;
+        samples[i] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed;
+        total += elapsed;
+        result->over_bound += elapsed > bound;
+    }
+    result->faults = minor_faults() - faults;
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        htfh_free(alloc, slots[i]);
+    }
+    qsort(samples, operations, sizeof(uint32_t), compare_u32);
+    result->mean_ns = (double) total / (double) operations;
+    result->tail_ns = samples[operations - 1 - operations / 10000];
+    result->worst_ns = samples[operations - 1];
+    return htfh_destroy(alloc);
+}
+
+static void print_result(const char* name, const RunResult* result) {
+    printf(
+        "%-10s %12.3f %8ld %10.1f %10u %10u %10zu %10zu\n",
+        name,
+        (double) result->create_ns / 1e6,
+        result->faults,
+        result->mean_ns,
+        result->tail_ns,
+        result->worst_ns,
+        result->over_bound,
+        result->failures
+    );
+}
+
+int main(int argc, char* argv[]) {
+    const size_t operations = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_OPERATIONS;
+    const uint64_t bound = argc > 2 ? strtoull(argv[2], NULL, 0) : DEFAULT_BOUND_NS;
+    const size_t heap_size = argc > 3 ? strtoull(argv[3], NULL, 0) : DEFAULT_HEAP_SIZE;
+    if (!operations) {
+        fprintf(stderr, "Usage: %s [operations] [bound ns] [heap bytes]\n", argv[0]);
+        return 1;
+    }
+    /* Touched up front so the sample stores do not fault inside the workload. */
+    uint32_t* samples = malloc(operations * sizeof(uint32_t));
+    if (samples == NULL) {
+        fprintf(stderr, "Unable to allocate samples\n");
+        return 1;
+    }
+    memset(samples, 0, operations * sizeof(uint32_t));
+
+    struct sched_param param = { .sched_priority = sched_get_priority_min(SCHED_FIFO) };
+    const int fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    printf(
+        "operations: %zu, bound: %llu ns, heap: %zu bytes, scheduling: %s\n\n",
+        operations,
+        (unsigned long long) bound,
+        heap_size,
+        fifo ? "SCHED_FIFO" : "default"
+    );
+    printf(
+        "%-10s %12s %8s %10s %10s %10s %10s %10s\n",
+        "heap", "create ms", "faults", "mean ns", "p99.99 ns", "max ns", "over bound", "failures"
+    );
+    RunResult result;
+    if (run(0, operations, bound, heap_size, samples, &result) != 0) {
+        alloc_perror("Default heap failed: ");
+        return 1;
+    }
+    print_result("default", &result);
+    if (run(HTFH_CREATE_REALTIME, operations, bound, heap_size, samples, &result) != 0) {
+        alloc_perror("Realtime heap failed, RLIMIT_MEMLOCK may be too low: ");
+        return 1;
+    }
+    print_result("realtime", &result);
+    free(samples);
+
+    const char* measure = fifo ? "worst case" : "p99.99";
+    const uint32_t latency = fifo ? result.worst_ns : result.tail_ns;
+    if (result.faults != 0) {
+        printf("\nFAIL: realtime heap took %ld page faults\n", result.faults);
+        return 1;
+    } else if (latency > bound) {
+        printf("\nFAIL: realtime %s %u ns exceeds the %llu ns bound\n", measure, latency, (unsigned long long) bound);
+        return 1;
+    }
+    printf("\nPASS: realtime %s %u ns within the %llu ns bound\n", measure, latency, (unsigned long long) bound);
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "htfh.h"
+#include "stats.h"
+#include "allocator_errno.h"
+
+/*
+** Live monitor of an allocator publishing with htfh_stats_publish.
+**
+** Attaches to the statistics segment read-only and redraws once per
+** refresh. Shown:
+** - pool, used and free bytes, with used as a share of the pools
+** - mallocs, frees, reallocs and HEAP_FULL refusals per second, from the
+**   counts of successive samples
+** - external fragmentation, 1 - largest free / free bytes, with the
+**   largest free block bounded from below by its size class
+** - free list occupancy, one row per first level class, a '#' for each
+**   second level list holding a free block
+**
+** The monitored process is never written to or signalled. The display
+** is marked stale once samples stop advancing, as they do when the
+** process exits.
+**
+** Usage: htfh_top <shm name | /proc/<pid>/fd/<fd>> [refresh ms] [refreshes]
+*/
+
+#define DEFAULT_REFRESH_MS 1000
+
+static const char* counter_names[STATS_COUNTER_COUNT] = {
+    [STATS_MALLOC] = "malloc/s",
+    [STATS_FREE] = "free/s",
+    [STATS_REALLOC] = "realloc/s",
+    [STATS_HEAP_FULL] = "full/s",
+};
+
+/* Smallest block size held by the list of class fl, sl. */
+static uint64_t class_size(const HeapStatsPage* page, unsigned int fl, unsigned int sl) {
+    const uint64_t sl_count = (uint64_t) 1 << page->sl_index_count_log2;
+    if (fl == 0) {
+        return sl * (((uint64_t) 1 << page->fl_index_shift) / sl_count);
+    }
+    const unsigned int shift = fl + page->fl_index_shift - 1;
+    return (sl_count + sl) << (shift - page->sl_index_count_log2);
+}
+
+/* Lower bound on the largest free block, 0 if no list holds one. */
+static uint64_t largest_free(const HeapStatsPage* page, const HeapStatsSample* sample) {
+    for (int fl = (int) page->fl_index_count - 1; fl >= 0; fl--) {
+        const uint32_t bits = sample->sl_bitmap[fl];
+        if ((sample->fl_bitmap >> fl) & 1 && bits) {
+            return class_size(page, (unsigned int) fl, 31 - (unsigned int) __builtin_clz(bits));
+        }
+    }
+    return 0;
+}
+
+static void format_bytes(char* out, size_t length, uint64_t bytes) {
+    static const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double value = (double) bytes;
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        unit++;
+    }
+    snprintf(out, length, unit ? "%.1f %s" : "%.0f %s", value, units[unit]);
+}
+
+static void render(const char* name, const HeapStatsPage* page, const HeapStatsSample* sample, const HeapStatsSample* prev, int stale) {
+    char pool[32], used[32], free_bytes[32], largest[32];
+    const uint64_t largest_bytes = largest_free(page, sample);
+    format_bytes(pool, sizeof(pool), sample->pool_bytes);
+    format_bytes(used, sizeof(used), sample->used_bytes);
+    format_bytes(free_bytes, sizeof(free_bytes), sample->free_bytes);
+    format_bytes(largest, sizeof(largest), largest_bytes);
+    printf(
+        "htfh_top %s  pid %llu  sample every %u ms%s\n\n",
+        name,
+        (unsigned long long) page->pid,
+        page->interval_ms,
+        stale ? "  [stale]" : ""
+    );
+    printf(
+        "pools %s  used %s (%.1f%%)  free %s  largest free >= %s\n",
+        pool,
+        used,
+        sample->pool_bytes ? 100.0 * (double) sample->used_bytes / (double) sample->pool_bytes : 0.0,
+        free_bytes,
+        largest
+    );
+    printf(
+        "fragmentation %.1f%%\n\n",
+        sample->free_bytes && largest_bytes <= sample->free_bytes
+            ? 100.0 * (1.0 - (double) largest_bytes / (double) sample->free_bytes)
+            : 0.0
+    );
+    const double seconds = prev != NULL && sample->time_ns > prev->time_ns
+        ? (double) (sample->time_ns - prev->time_ns) / 1e9
+        : 0.0;
+    for (size_t i = 0; i < STATS_COUNTER_COUNT; i++) {
+        const double rate = seconds > 0.0 ? (double) (sample->counters[i] - prev->counters[i]) / seconds : 0.0;
+        printf("%-10s %12.0f   total %llu\n", counter_names[i], rate, (unsigned long long) sample->counters[i]);
+    }
+    printf("\n%-12s %s\n", "class from", "free lists");
+    const unsigned int sl_count = 1u << page->sl_index_count_log2;
+    for (unsigned int fl = 0; fl < page->fl_index_count; fl++) {
+        if (!((sample->fl_bitmap >> fl) & 1)) {
+            continue;
+        }
+        char size[32], lists[33];
+        format_bytes(size, sizeof(size), class_size(page, fl, 0));
+        for (unsigned int sl = 0; sl < sl_count && sl < sizeof(lists) - 1; sl++) {
+            lists[sl] = (sample->sl_bitmap[fl] >> sl) & 1 ? '#' : '.';
+        }
+        lists[sl_count < sizeof(lists) - 1 ? sl_count : sizeof(lists) - 1] = '\0';
+        printf("%-12s %s\n", size, lists);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <shm name | /proc/<pid>/fd/<fd>> [refresh ms] [refreshes]\n", argv[0]);
+        return 1;
+    }
+    const long refresh_ms = argc > 2 ? strtol(argv[2], NULL, 0) : DEFAULT_REFRESH_MS;
+    const long refreshes = argc > 3 ? strtol(argv[3], NULL, 0) : 0;
+    if (refresh_ms <= 0) {
+        fprintf(stderr, "Refresh must be a positive number of milliseconds\n");
+        return 1;
+    }
+    const HeapStatsPage* page = htfh_stats_attach(argv[1]);
+    if (page == NULL) {
+        alloc_perror("Unable to attach to statistics segment: ");
+        return 1;
+    }
+    const int tty = isatty(STDOUT_FILENO);
+    const struct timespec delay = { refresh_ms / 1000, (refresh_ms % 1000) * 1000000L };
+    HeapStatsSample samples[2];
+    HeapStatsSample* prev = NULL;
+    /* Samples are stamped with the same monotonic clock, stale once three intervals old. */
+    const uint64_t stale_ns = 3ULL * page->interval_ms * 1000000ULL;
+    for (long i = 0; !refreshes || i < refreshes; i++) {
+        HeapStatsSample* sample = &samples[i & 1];
+        if (htfh_stats_read(page, sample) != 0) {
+            alloc_perror("Unable to read statistics: ");
+            htfh_stats_detach(page);
+            return 1;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const uint64_t now_ns = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+        if (tty) {
+            /* Home the cursor and clear the screen. */
+            printf("\033[H\033[2J");
+        } else if (i > 0) {
+            printf("\n");
+        }
+        render(argv[1], page, sample, prev, now_ns > sample->time_ns + stale_ns);
+        prev = sample;
+        if (!refreshes || i + 1 < refreshes) {
+            nanosleep(&delay, NULL);
+        }
+    }
+    return htfh_stats_detach(page) == 0 ? 0 : 1;
+}
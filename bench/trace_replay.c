@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "htfh.h"
+#include "trace.h"
+#include "allocator_errno.h"
+
+/*
+** Replay of a trace recorded with htfh_trace_start.
+**
+** The records are sorted into their original order and re-run from a
+** single thread against a fresh heap, mapping every recorded address to
+** the block the replay obtained for it. Reported:
+** - per operation count, mean, median, 99th percentile and worst latency
+**   in nanoseconds
+** - allocations failing, and frees of objects the trace never allocated
+** - peak requested and peak usable bytes live at once
+** - at regular intervals: live bytes, free block count, largest free
+**   block and external fragmentation, 1 - largest free / free bytes
+**
+** Usage: htfh_trace_replay <trace file> [heap bytes] [fit policy] [samples]
+*/
+
+#define DEFAULT_HEAP_SIZE (96 * 1024 * 1024)
+#define DEFAULT_SAMPLES 20
+
+/* Hash map key of an empty and of a removed slot, neither is a block address. */
+#define SLOT_EMPTY 0
+#define SLOT_REMOVED 1
+
+typedef struct LiveObject {
+    uint64_t key;
+    void* ptr;
+    size_t size;
+} LiveObject;
+
+typedef struct LiveMap {
+    LiveObject* slots;
+    size_t mask;
+} LiveMap;
+
+typedef struct OpLatency {
+    const char* name;
+    uint32_t* samples;
+    size_t count;
+    uint64_t total;
+} OpLatency;
+
+typedef struct FreeStats {
+    size_t free_bytes;
+    size_t largest_free;
+    size_t free_blocks;
+} FreeStats;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static inline size_t map_hash(uint64_t key, size_t mask) {
+    return (size_t) ((key >> 3) * 0x9E3779B97F4A7C15ULL) & mask;
+}
+
+static LiveObject* map_find(const LiveMap* map, uint64_t key) {
+    for (size_t i = map_hash(key, map->mask);; i = (i + 1) & map->mask) {
+        if (map->slots[i].key == key) {
+            return &map->slots[i];
+        } else if (map->slots[i].key == SLOT_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+static void map_insert(LiveMap* map, uint64_t key, void* ptr, size_t size) {
+    size_t i = map_hash(key, map->mask);
+    while (map->slots[i].key != SLOT_EMPTY && map->slots[i].key != SLOT_REMOVED) {
+        i = (i + 1) & map->mask;
+    }
+    map->slots[i].key = key;
+    map->slots[i].ptr = ptr;
+    map->slots[i].size = size;
+}
+
+static int compare_seq(const void* a, const void* b) {
+    const uint64_t x = ((const TraceRecord*) a)->seq;
+    const uint64_t y = ((const TraceRecord*) b)->seq;
+    return (x > y) - (x < y);
+}
+
+static int compare_u32(const void* a, const void* b) {
+    const uint32_t x = *(const uint32_t*) a;
+    const uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void free_stats_walker(void* ptr, size_t size, int used, void* user) {
+    FreeStats* stats = user;
+    (void) ptr;
+    if (used) {
+        return;
+    }
+    stats->free_bytes += size;
+    stats->free_blocks++;
+    if (size > stats->largest_free) {
+        stats->largest_free = size;
+    }
+}
+
+static TraceRecord* read_trace(const char* path, size_t* count) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Unable to open trace");
+        return NULL;
+    }
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != TRACE_VERSION
+        || header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s is not a trace of this version\n", path);
+        fclose(file);
+        return NULL;
+    }
+    size_t capacity = 1024;
+    size_t length = 0;
+    TraceRecord* records = malloc(capacity * sizeof(*records));
+    while (records != NULL) {
+        length += fread(&records[length], sizeof(*records), capacity - length, file);
+        if (length < capacity) {
+            break;
+        }
+        TraceRecord* grown = realloc(records, 2 * capacity * sizeof(*records));
+        if (grown == NULL) {
+            free(records);
+            records = NULL;
+            break;
+        }
+        records = grown;
+        capacity *= 2;
+    }
+    fclose(file);
+    if (records == NULL) {
+        fprintf(stderr, "Unable to load trace\n");
+        return NULL;
+    }
+    qsort(records, length, sizeof(*records), compare_seq);
+    *count = length;
+    return records;
+}
+
+static void print_sample(Allocator* alloc, size_t op, size_t live_bytes, size_t live_usable) {
+    FreeStats stats = { 0, 0, 0 };
+    htfh_walk_pools(alloc, free_stats_walker, &stats);
+    const double fragmentation = stats.free_bytes
+        ? 1.0 - (double) stats.largest_free / (double) stats.free_bytes
+        : 0.0;
+    printf(
+        "%12zu %14zu %14zu %10zu %14zu %9.2f%%\n",
+        op,
+        live_bytes,
+        live_usable,
+        stats.free_blocks,
+        stats.largest_free,
+        fragmentation * 100.0
+    );
+}
+
+static void print_latency(OpLatency* latency) {
+    if (!latency->count) {
+        return;
+    }
+    qsort(latency->samples, latency->count, sizeof(uint32_t), compare_u32);
+    printf(
+        "%-10s %12zu %10.1f %10u %10u %10u\n",
+        latency->name,
+        latency->count,
+        (double) latency->total / (double) latency->count,
+        latency->samples[latency->count / 2],
+        latency->samples[latency->count - 1 - latency->count / 100],
+        latency->samples[latency->count - 1]
+    );
+}
+
+static inline void record_latency(OpLatency* latency, uint64_t elapsed) {
+    latency->samples[latency->count++] = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed;
+    latency->total += elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <trace file> [heap bytes] [fit policy] [samples]\n", argv[0]);
+        return 1;
+    }
+    const size_t heap_size = argc > 2 ? strtoull(argv[2], NULL, 0) : DEFAULT_HEAP_SIZE;
+    const unsigned int policy = argc > 3 ? (unsigned int) strtoul(argv[3], NULL, 0) : FIT_GOOD;
+    const size_t sample_count = argc > 4 ? strtoull(argv[4], NULL, 0) : DEFAULT_SAMPLES;
+
+    size_t count = 0;
+    TraceRecord* records = read_trace(argv[1], &count);
+    if (records == NULL) {
+        return 1;
+    }
+    Allocator* alloc = htfh_create(heap_size);
+    if (alloc == NULL) {
+        alloc_perror("Unable to create allocator: ");
+        return 1;
+    } else if (htfh_set_fit_policy(alloc, policy) != 0) {
+        alloc_perror("Unable to set fit policy: ");
+        return 1;
+    }
+    size_t capacity = 16;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    LiveMap map = { calloc(capacity, sizeof(LiveObject)), capacity - 1 };
+    OpLatency latencies[] = {
+        [TRACE_MALLOC] = { "malloc", malloc(count * sizeof(uint32_t)), 0, 0 },
+        [TRACE_FREE] = { "free", malloc(count * sizeof(uint32_t)), 0, 0 },
+        [TRACE_REALLOC] = { "realloc", malloc(count * sizeof(uint32_t)), 0, 0 },
+        [TRACE_MEMALIGN] = { "memalign", malloc(count * sizeof(uint32_t)), 0, 0 },
+    };
+    if (map.slots == NULL || latencies[TRACE_MALLOC].samples == NULL || latencies[TRACE_FREE].samples == NULL
+        || latencies[TRACE_REALLOC].samples == NULL || latencies[TRACE_MEMALIGN].samples == NULL) {
+        fprintf(stderr, "Unable to allocate replay state\n");
+        return 1;
+    }
+
+    printf("trace: %s, records: %zu, heap: %zu bytes, fit policy: %u\n\n", argv[1], count, heap_size, policy);
+    printf(
+        "%12s %14s %14s %10s %14s %10s\n",
+        "operation", "live bytes", "usable bytes", "free blks", "largest free", "frag"
+    );
+    const size_t interval = sample_count && count > sample_count ? count / sample_count : count;
+    size_t live_bytes = 0, live_usable = 0, peak_bytes = 0, peak_usable = 0;
+    size_t failures = 0, unknown = 0;
+    for (size_t i = 0; i < count; i++) {
+        const TraceRecord* record = &records[i];
+        LiveObject* object = NULL;
+        if (record->op == TRACE_FREE || (record->op == TRACE_REALLOC && record->ptr != 0)) {
+            if ((object = map_find(&map, record->ptr)) == NULL) {
+                unknown++;
+                continue;
+            }
+            live_bytes -= object->size;
+            live_usable -= htfh_block_size(object->ptr);
+        }
+        void* ptr = NULL;
+        const uint64_t start = now_ns();
+        switch (record->op) {
+            case TRACE_MALLOC:
+                ptr = htfh_malloc(alloc, record->size);
+                break;
+            case TRACE_MEMALIGN:
+                ptr = htfh_memalign(alloc, (size_t) 1 << record->align_shift, record->size);
+                break;
+            case TRACE_REALLOC:
+                ptr = htfh_realloc(alloc, object != NULL ? object->ptr : NULL, record->size);
+                break;
+            case TRACE_FREE:
+                htfh_free(alloc, object->ptr);
+                break;
+            default:
+                continue;
+        }
+        record_latency(&latencies[record->op], now_ns() - start);
+
+        if (object != NULL && (ptr != NULL || record->size == 0)) {
+            /* Freed, or moved by a successful realloc. */
+            object->key = SLOT_REMOVED;
+        } else if (object != NULL) {
+            /* A failed realloc leaves the block in place. */
+            live_bytes += object->size;
+            live_usable += htfh_block_size(object->ptr);
+        }
+        if (ptr != NULL) {
+            map_insert(&map, record->result, ptr, record->size);
+            live_bytes += record->size;
+            live_usable += htfh_block_size(ptr);
+        } else if (record->op != TRACE_FREE && record->size != 0) {
+            failures++;
+        }
+        peak_bytes = live_bytes > peak_bytes ? live_bytes : peak_bytes;
+        peak_usable = live_usable > peak_usable ? live_usable : peak_usable;
+        if (interval && (i + 1) % interval == 0) {
+            print_sample(alloc, i + 1, live_bytes, live_usable);
+        }
+    }
+
+    printf("\n%-10s %12s %10s %10s %10s %10s\n", "operation", "count", "mean ns", "p50 ns", "p99 ns", "max ns");
+    print_latency(&latencies[TRACE_MALLOC]);
+    print_latency(&latencies[TRACE_MEMALIGN]);
+    print_latency(&latencies[TRACE_REALLOC]);
+    print_latency(&latencies[TRACE_FREE]);
+    printf(
+        "\nfailed allocations: %zu, unknown frees: %zu, peak live bytes: %zu, peak usable bytes: %zu\n",
+        failures,
+        unknown,
+        peak_bytes,
+        peak_usable
+    );
+
+    for (size_t i = 0; i <= map.mask; i++) {
+        if (map.slots[i].key != SLOT_EMPTY && map.slots[i].key != SLOT_REMOVED) {
+            htfh_free(alloc, map.slots[i].ptr);
+        }
+    }
+    free(map.slots);
+    free(records);
+    for (size_t i = TRACE_MALLOC; i <= TRACE_MEMALIGN; i++) {
+        free(latencies[i].samples);
+    }
+    return htfh_destroy(alloc) == 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+#include "arena.h"
+#include <stdint.h>
+
+static inline char* chunk_data(ArenaChunk* chunk) {
+    return (char*) (chunk + 1);
+}
+
+/* Take a new chunk of at least size usable bytes from the heap and make it current. */
+static ArenaChunk* arena_chunk_push(Arena* arena, size_t size) {
+    if (size > SIZE_MAX - sizeof(ArenaChunk)) {
+        set_alloc_errno(HEAP_FULL);
+        return NULL;
+    }
+    size_t usable = 0;
+    ArenaChunk* chunk = htfh_malloc_usable(arena->alloc, sizeof(ArenaChunk) + size, &usable);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    /* Rounding and unsplittable slack in the block is usable by the arena. */
+    chunk->size = usable - sizeof(ArenaChunk);
+    chunk->prev = arena->chunk;
+    arena->chunk = chunk;
+    arena->offset = 0;
+    return chunk;
+}
+
+/* Return chunks newer than the given one to the heap. */
+static int arena_chunk_pop_until(Arena* arena, const ArenaChunk* until) {
+    while (arena->chunk != until) {
+        ArenaChunk* prev = arena->chunk->prev;
+        if (htfh_free(arena->alloc, arena->chunk) != 0) {
+            return -1;
+        }
+        arena->chunk = prev;
+    }
+    return 0;
+}
+
+Arena* htfh_arena_create(Allocator* alloc, size_t chunk_size) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    } else if (!chunk_size) {
+        set_alloc_errno(NON_ZERO_BLOCK_SIZE);
+        return NULL;
+    }
+    Arena* arena = htfh_malloc(alloc, sizeof(*arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->alloc = alloc;
+    arena->chunk_size = chunk_size;
+    arena->chunk = NULL;
+    arena->offset = 0;
+    if (arena_chunk_push(arena, chunk_size) == NULL) {
+        htfh_free(alloc, arena);
+        return NULL;
+    }
+    return arena;
+}
+
+int htfh_arena_destroy(Arena* arena) {
+    if (arena == NULL) {
+        set_alloc_errno(NULL_ARENA_INSTANCE);
+        return -1;
+    } else if (arena_chunk_pop_until(arena, NULL) != 0) {
+        return -1;
+    }
+    return htfh_free(arena->alloc, arena);
+}
+
+void* htfh_arena_memalign(Arena* arena, size_t align, size_t size) {
+    if (arena == NULL) {
+        set_alloc_errno(NULL_ARENA_INSTANCE);
+        return NULL;
+    } else if (!size) {
+        return NULL;
+    } else if ((align & (align - 1)) != 0) {
+        set_alloc_errno(ALIGN_POWER_OF_TWO);
+        return NULL;
+    }
+    align = htfh_max(align, (size_t) ALIGN_SIZE);
+    if (align > SIZE_MAX - sizeof(ArenaChunk) || size > SIZE_MAX - sizeof(ArenaChunk) - align) {
+        /* No chunk could hold it, and the sizes below would wrap. */
+        set_alloc_errno(HEAP_FULL);
+        return NULL;
+    }
+    /* Offsets are compared against the space left, end addresses could wrap. */
+    char* base = chunk_data(arena->chunk);
+    size_t offset = arena->offset + ((align - ((uintptr_t) base + arena->offset) % align) % align);
+    if (offset > arena->chunk->size || size > arena->chunk->size - offset) {
+        /* Oversized requests get a chunk of their own. */
+        if (arena_chunk_push(arena, htfh_max(arena->chunk_size, size + align)) == NULL) {
+            return NULL;
+        }
+        base = chunk_data(arena->chunk);
+        offset = (align - (uintptr_t) base % align) % align;
+    }
+    arena->offset = offset + size;
+    return base + offset;
+}
+
+void* htfh_arena_alloc(Arena* arena, size_t size) {
+    return htfh_arena_memalign(arena, ALIGN_SIZE, size);
+}
+
+ArenaMark htfh_arena_save(const Arena* arena) {
+    ArenaMark mark = { NULL, 0 };
+    if (arena == NULL) {
+        set_alloc_errno(NULL_ARENA_INSTANCE);
+        return mark;
+    }
+    mark.chunk = arena->chunk;
+    mark.offset = arena->offset;
+    return mark;
+}
+
+int htfh_arena_restore(Arena* arena, ArenaMark mark) {
+    if (arena == NULL) {
+        set_alloc_errno(NULL_ARENA_INSTANCE);
+        return -1;
+    }
+    /* The mark must refer to the current chunk or one of its predecessors. */
+    const ArenaChunk* chunk = arena->chunk;
+    while (chunk != NULL && chunk != mark.chunk) {
+        chunk = chunk->prev;
+    }
+    if (chunk == NULL || mark.offset > mark.chunk->size
+        || (chunk == arena->chunk && mark.offset > arena->offset)) {
+        set_alloc_errno(INVALID_ARENA_MARK);
+        return -1;
+    } else if (arena_chunk_pop_until(arena, mark.chunk) != 0) {
+        return -1;
+    }
+    arena->offset = mark.offset;
+    return 0;
+}
+
+int htfh_arena_reset(Arena* arena) {
+    if (arena == NULL) {
+        set_alloc_errno(NULL_ARENA_INSTANCE);
+        return -1;
+    }
+    ArenaChunk* first = arena->chunk;
+    while (first->prev != NULL) {
+        first = first->prev;
+    }
+    if (arena_chunk_pop_until(arena, first) != 0) {
+        return -1;
+    }
+    arena->offset = 0;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_ARENA_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_ARENA_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "htfh.h"
+
+/*
+** Bump-pointer arena carved from an allocator's heap.
+**
+** Chunks are taken from the heap with htfh_malloc and handed out by
+** advancing an offset, objects carry no header and are never freed
+** individually. Memory is released in bulk by restoring a mark or by
+** resetting the arena. An arena is not thread safe, it is meant to be
+** owned by a single request or job.
+*/
+typedef struct ArenaChunk {
+    /* Chunk allocated before this one, NULL for the first chunk. */
+    struct ArenaChunk* prev;
+    /* Usable bytes following this header. */
+    size_t size;
+} ArenaChunk;
+
+typedef struct Arena {
+    Allocator* alloc;
+    size_t chunk_size;
+    /* Current chunk, the newest in the list. */
+    ArenaChunk* chunk;
+    /* Bump offset into the current chunk. */
+    size_t offset;
+} Arena;
+
+/* Saved arena position, restoring it releases everything allocated since. */
+typedef struct ArenaMark {
+    ArenaChunk* chunk;
+    size_t offset;
+} ArenaMark;
+
+/* Create an arena taking chunks of chunk_size bytes from the heap. */
+Arena* htfh_arena_create(Allocator* alloc, size_t chunk_size);
+/* Return every chunk and the arena itself to the heap. */
+int htfh_arena_destroy(Arena* arena);
+
+__attribute__((malloc)) __attribute__((alloc_size(2))) void* htfh_arena_alloc(Arena* arena, size_t size);
+__attribute__((malloc)) __attribute__((alloc_size(3))) void* htfh_arena_memalign(Arena* arena, size_t align, size_t size);
+
+/* Marks nest, a mark is invalidated by restoring an older one or resetting. */
+ArenaMark htfh_arena_save(const Arena* arena);
+int htfh_arena_restore(Arena* arena, ArenaMark mark);
+/*
+** Release everything allocated from the arena, keeping the first chunk
+** warm for the next use. The cost does not depend on the number of
+** allocations made.
+*/
+int htfh_arena_reset(Arena* arena);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_ARENA_
@@ -37,6 +37,24 @@ inline void block_set_prev_used(BlockHeader* block) {
     block->size &= ~block_header_prev_free_bit;
 }
 
+inline int block_is_mapped(const BlockHeader* block) {
+    return !block_is_free(block) && block_is_prev_free(block) && block_link_decode(block, block->prev_phys_block) == NULL;
+}
+
+inline void block_set_mapped(BlockHeader* block) {
+    block->prev_phys_block = block_link_encode(block, NULL);
+    block_set_used(block);
+    block_set_prev_free(block);
+}
+
+inline int block_is_quick(const BlockHeader* block) {
+    return !block_is_free(block) && block_prev_free(block) == block;
+}
+
+inline void block_set_quick(BlockHeader* block) {
+    block_link_prev_free(block, block);
+}
+
 inline BlockHeader* block_from_ptr(const void* ptr) {
     return (BlockHeader*)((unsigned char*) ptr - block_start_offset);
 }
@@ -56,7 +74,7 @@ BlockHeader* block_prev(const BlockHeader* block) {
         set_alloc_errno(PREV_BLOCK_NOT_FREE);
         return NULL;
     }
-    return block->prev_phys_block;
+    return block_link_decode(block, block->prev_phys_block);
 }
 
 /* Return location of next existing block. */
@@ -78,7 +96,7 @@ BlockHeader* block_link_next(BlockHeader* block) {
     if (next == NULL) {
         return NULL;
     }
-    next->prev_phys_block = block;
+    next->prev_phys_block = block_link_encode(next, block);
     return next;
 }
 
@@ -90,6 +108,7 @@ int block_mark_as_free(BlockHeader* block) {
     }
     block_set_prev_free(next);
     block_set_free(block);
+    return 0;
 }
 
 int block_mark_as_used(BlockHeader* block) {
@@ -8,8 +8,33 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include "constants.h"
 #include "utils.h"
+
+/*
+** With HTFH_COMPACT_HEADERS defined, links between blocks are stored as
+** signed 32-bit distances from the block holding them to their target, in
+** units of ALIGN_SIZE, and sizes as 32-bit values. The size word and the
+** prev_phys_block field ahead of it are still padded to ALIGN_SIZE to keep
+** payloads aligned. On 64-bit targets the per-block overhead is therefore
+** unchanged at 8 bytes; only the free list links shrink, taking the header
+** from 32 to 24 bytes and the minimum block from 24 to 16 bytes. Every
+** block, block_null included, must lie within link range of the
+** controller.
+*/
+#ifdef HTFH_COMPACT_HEADERS
+typedef int32_t block_link_t;
+typedef uint32_t block_size_t;
+/* Link value of a null pointer, a distance no block can be at. */
+#define BLOCK_LINK_NULL INT32_MIN
+/* Furthest a pool may end from the controller in either direction. */
+#define BLOCK_LINK_SPAN_MAX ((size_t) INT32_MAX / 2 * ALIGN_SIZE)
+#else
+typedef struct BlockHeader* block_link_t;
+typedef size_t block_size_t;
+#endif
+
 /*
 ** Block header structure.
 **
@@ -22,16 +47,29 @@ extern "C" {
 */
 typedef struct BlockHeader {
     /* Points to the previous physical block. */
-    struct BlockHeader* prev_phys_block;
+    block_link_t prev_phys_block;
 
     /* The size of this block, excluding the block header. */
-    size_t size;
+    _Alignas(ALIGN_SIZE) block_size_t size;
 
     /* Next and previous free blocks. */
-    struct BlockHeader* next_free;
-    struct BlockHeader* prev_free;
+    _Alignas(ALIGN_SIZE) block_link_t next_free;
+    block_link_t prev_free;
 } BlockHeader;
 
+#ifdef HTFH_COMPACT_HEADERS
+htfh_static_assert(FL_INDEX_MAX < 32);
+#endif
+
+/*
+** Payloads start ALIGN_SIZE aligned and the next block's payload follows
+** a whole number of ALIGN_SIZE units later, which suits any type aligned
+** to no more than ALIGN_SIZE. Stricter alignment goes through memalign.
+*/
+htfh_static_assert(offsetof(BlockHeader, size) % ALIGN_SIZE == 0);
+htfh_static_assert(offsetof(BlockHeader, next_free) % ALIGN_SIZE == 0);
+htfh_static_assert(ALIGN_SIZE >= _Alignof(void*) && _Alignof(max_align_t) % ALIGN_SIZE == 0);
+
 /*
 ** Since block sizes are always at least a multiple of 4, the two least
 ** significant bits of the size field are used to store the block status:
@@ -45,19 +83,62 @@ static const size_t block_header_prev_free_bit = 1 << 1;
 ** The size of the block header exposed to used blocks is the size field.
 ** The prev_phys_block field is stored *inside* the previous free block.
 */
-static const size_t block_header_overhead = sizeof(size_t);
+static const size_t block_header_overhead = offsetof(BlockHeader, next_free) - offsetof(BlockHeader, size);
 
 /* User data starts directly after the size field in a used block. */
-static const size_t block_start_offset = offsetof(BlockHeader, size) + sizeof(size_t);
+static const size_t block_start_offset = offsetof(BlockHeader, next_free);
 
 /*
 ** A free block must be large enough to store its header minus the size of
 ** the prev_phys_block field, and no larger than the number of addressable
 ** bits for FL_INDEX.
 */
-static const size_t block_size_min = sizeof(BlockHeader) - sizeof(BlockHeader*);
+static const size_t block_size_min = sizeof(BlockHeader) - offsetof(BlockHeader, size);
 static const size_t block_size_max = (size_t) 1 << FL_INDEX_MAX;
 
+/* Largest size the size field of a direct-mapped block can hold. */
+#ifdef HTFH_COMPACT_HEADERS
+static const size_t block_mapped_size_max = (size_t) UINT32_MAX & ~(size_t) (ALIGN_SIZE - 1);
+#else
+static const size_t block_mapped_size_max = SIZE_MAX;
+#endif
+
+/* Convert between a pointer and its link as stored in block. */
+static inline BlockHeader* block_link_decode(const BlockHeader* block, block_link_t link) {
+#ifdef HTFH_COMPACT_HEADERS
+    return link == BLOCK_LINK_NULL ? NULL : (BlockHeader*) ((const char*) block + (ptrdiff_t) link * ALIGN_SIZE);
+#else
+    (void) block;
+    return link;
+#endif
+}
+
+static inline block_link_t block_link_encode(const BlockHeader* block, const BlockHeader* target) {
+#ifdef HTFH_COMPACT_HEADERS
+    return target == NULL ? BLOCK_LINK_NULL : (block_link_t) (((const char*) target - (const char*) block) / ALIGN_SIZE);
+#else
+    (void) block;
+    return (BlockHeader*) target;
+#endif
+}
+
+/* Free list links, only valid while the block is free or is block_null. */
+static inline BlockHeader* block_next_free(const BlockHeader* block) {
+    return block_link_decode(block, block->next_free);
+}
+
+static inline BlockHeader* block_prev_free(const BlockHeader* block) {
+    return block_link_decode(block, block->prev_free);
+}
+
+static inline void block_link_next_free(BlockHeader* block, const BlockHeader* next) {
+    block->next_free = block_link_encode(block, next);
+}
+
+static inline void block_link_prev_free(BlockHeader* block, const BlockHeader* prev) {
+    block->prev_free = block_link_encode(block, prev);
+}
+
 size_t block_size(const BlockHeader* block);
 void block_set_size(BlockHeader* block, size_t size);
 int block_is_last(const BlockHeader* block);
@@ -67,6 +148,22 @@ void block_set_used(BlockHeader* block);
 int block_is_prev_free(const BlockHeader* block);
 void block_set_prev_free(BlockHeader* block);
 void block_set_prev_used(BlockHeader* block);
+/*
+** Direct-mapped blocks live outside of any pool. They are tagged as used
+** with the prev-free bit set and a null prev_phys_block, a combination
+** that cannot occur inside a pool since a free previous block always
+** links back to itself.
+*/
+int block_is_mapped(const BlockHeader* block);
+void block_set_mapped(BlockHeader* block);
+/*
+** A used block held on a quick-list links back to itself through
+** prev_free, as only block_null otherwise does. The field lies in the
+** payload of a used block, so a match only says the block may be
+** quick-listed.
+*/
+int block_is_quick(const BlockHeader* block);
+void block_set_quick(BlockHeader* block);
 BlockHeader* block_from_ptr(const void* ptr);
 void* block_to_ptr(const BlockHeader* block);
 /* Return location of next block after block of given size. */
@@ -7,12 +7,29 @@
 extern "C" {
 #endif
 
+#include "../preprocessor/checks.h"
+
 enum htfh_public {
     /* log2 of number of linear subdivisions of block sizes. Larger
     ** values require more memory in the control structure. Values of
     ** 4 or 5 are typical.
     */
     SL_INDEX_COUNT_LOG2 = 5,
+
+    /* Largest block size held on a deferred coalescing quick-list. */
+    QUICK_LIST_SIZE_MAX = 512,
+
+    /* Blocks held by a single quick-list before it is coalesced. */
+    QUICK_LIST_DEPTH = 64,
+
+    /* Smallest backing block, in bytes, taken from the heap by an object pool. */
+    OBJPOOL_SLAB_SIZE_MIN = 16384,
+
+    /* Pools registered per allocator, the primary heap pool included. */
+    POOL_COUNT_MAX = 16,
+
+    /* Allocation tags with their own byte budget per allocator. */
+    TAG_COUNT_MAX = 64,
 };
 
 enum htfh_private {
@@ -24,7 +41,10 @@ enum htfh_private {
     ALIGN_SIZE_LOG2 = 2,
 #endif
     ALIGN_SIZE = (1 << ALIGN_SIZE_LOG2),
-#if defined (ARCH_64_BIT)
+#if defined (ARCH_64_BIT) && defined (HTFH_COMPACT_HEADERS)
+    /* Compact block sizes are 32-bit, so every block must stay below 2^32 bytes. */
+    FL_INDEX_MAX = 31,
+#elif defined (ARCH_64_BIT)
     FL_INDEX_MAX = 32,
 #else
     FL_INDEX_MAX = 30,
@@ -33,6 +53,15 @@ enum htfh_private {
     FL_INDEX_SHIFT = (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2),
     FL_INDEX_COUNT = (FL_INDEX_MAX - FL_INDEX_SHIFT + 1),
     SMALL_BLOCK_SIZE = (1 << FL_INDEX_SHIFT),
+    /* One quick-list per exact block size up to QUICK_LIST_SIZE_MAX. */
+    QUICK_LIST_COUNT = (QUICK_LIST_SIZE_MAX >> ALIGN_SIZE_LOG2) + 1,
+    /* Alignment of state kept apart to avoid sharing cache lines. */
+    CACHE_LINE_SIZE = 64,
+    /* Recent layout changes remembered for resuming heap inspection. */
+    LAYOUT_LOG_COUNT = 64,
+    /* Sizes below MAPPING_TABLE_SIZE_MAX are mapped by table lookup, one entry per aligned size. */
+    MAPPING_TABLE_COUNT = 1024,
+    MAPPING_TABLE_SIZE_MAX = (MAPPING_TABLE_COUNT << ALIGN_SIZE_LOG2),
 };
 
 #ifdef __cplusplus
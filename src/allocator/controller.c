@@ -26,10 +26,51 @@ BlockHeader* controller_search_suitable_block(Controller* control, int* fli, int
     return control->blocks[*fli][*sli];
 }
 
+void controller_layout_changed(Controller* control, const BlockHeader* absorbed) {
+    control->generation++;
+    control->absorbed[control->generation % LAYOUT_LOG_COUNT] = absorbed;
+}
+
+void controller_layout_invalidate(Controller* control) {
+    control->generation += LAYOUT_LOG_COUNT;
+}
+
+int controller_layout_valid(const Controller* control, size_t generation, const BlockHeader* block) {
+    if (control->generation - generation >= LAYOUT_LOG_COUNT) {
+        return 0;
+    }
+    for (size_t g = generation; g != control->generation; g++) {
+        if (control->absorbed[(g + 1) % LAYOUT_LOG_COUNT] == block) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Find the smallest block of at least size within a single free list. */
+BlockHeader* controller_search_best_in_class(Controller* control, size_t size, int fl, int sl) {
+    BlockHeader* best = NULL;
+    if (!(control->sl_bitmap[fl] & (1U << sl))) {
+        return NULL;
+    }
+    for (BlockHeader* block = control->blocks[fl][sl]; block != &control->block_null; block = block_next_free(block)) {
+        const size_t current = block_size(block);
+        if (current < size || (best != NULL && current >= block_size(best))) {
+            continue;
+        }
+        best = block;
+        if (current == size) {
+            /* Nothing can fit better, and in address order this is the lowest. */
+            break;
+        }
+    }
+    return best;
+}
+
 /* Remove a free block from the free list.*/
 int controller_remove_free_block(Controller* control, BlockHeader* block, int fl, int sl) {
-    BlockHeader* prev = block->prev_free;
-    BlockHeader* next = block->next_free;
+    BlockHeader* prev = block_prev_free(block);
+    BlockHeader* next = block_next_free(block);
     if (prev == NULL) {
         set_alloc_errno(PREV_BLOCK_NULL);
         return -1;
@@ -37,8 +78,9 @@ int controller_remove_free_block(Controller* control, BlockHeader* block, int fl
         set_alloc_errno(NEXT_BLOCK_NULL);
         return -1;
     }
-    next->prev_free = prev;
-    prev->next_free = next;
+    block_link_prev_free(next, prev);
+    block_link_next_free(prev, next);
+    control->free_bytes -= block_size(block);
 
     if (control->blocks[fl][sl] != block) {
         return 0;
@@ -67,20 +109,34 @@ int controller_insert_free_block(Controller* control, BlockHeader* block, int fl
         set_alloc_errno_msg(BLOCK_IS_NULL, "Cannot insert null entry into free list");
         return -1;
     }
-    block->next_free = current;
-    block->prev_free = &control->block_null;
-    current->prev_free = block;
     if (block_to_ptr(block) != align_ptr(block_to_ptr(block), ALIGN_SIZE)) {
         set_alloc_errno(BLOCK_NOT_ALIGNED);
         return -1;
     }
+    BlockHeader* prev = &control->block_null;
+    if (control->fit_policy & FIT_ADDRESS_ORDERED) {
+        /* Walk to the first block at a higher address and insert before it. */
+        while (current != &control->block_null && current < block) {
+            prev = current;
+            current = block_next_free(current);
+        }
+    }
+    block_link_next_free(block, current);
+    block_link_prev_free(block, prev);
+    block_link_prev_free(current, block);
     /*
-    ** Insert the new block at the head of the list, and mark the first-
-    ** and second-level bitmaps appropriately.
+    ** Insert the new block at the head of the list (or after its address
+    ** predecessor), and mark the first- and second-level bitmaps
+    ** appropriately.
     */
-    control->blocks[fl][sl] = block;
+    if (prev == &control->block_null) {
+        control->blocks[fl][sl] = block;
+    } else {
+        block_link_next_free(prev, block);
+    }
     control->fl_bitmap |= (1U << fl);
     control->sl_bitmap[fl] |= (1U << sl);
+    control->free_bytes += block_size(block);
     return 0;
 }
 
@@ -113,6 +169,7 @@ BlockHeader* controller_block_merge_prev(Controller* control, BlockHeader* block
     } else if (controller_block_remove(control, prev) != 0) {
         return NULL;
     }
+    controller_layout_changed(control, block);
     block = block_absorb(prev, block);
     return block;
 }
@@ -130,10 +187,129 @@ BlockHeader* controller_block_merge_next(Controller* control, BlockHeader* block
     } else if (controller_block_remove(control, next) != 0) {
         return NULL;
     }
+    controller_layout_changed(control, next);
     block = block_absorb(block, next);
     return block;
 }
 
+/* Absorb a used block into its free previous block, moving the payload down. */
+BlockHeader* controller_block_shift_into_prev(Controller* control, BlockHeader* block) {
+    BlockHeader* prev = block_prev(block);
+    if (prev == NULL) {
+        return NULL;
+    } else if (!block_is_free(prev)) {
+        set_alloc_errno(BLOCK_NOT_FREE);
+        return NULL;
+    } else if (controller_block_remove(control, prev) != 0) {
+        return NULL;
+    }
+    /*
+    ** Sizes must be read before the move, since the payload overwrites the
+    ** header of the used block. The combined block keeps the flags of prev
+    ** and is left free, the caller is expected to mark it as used.
+    */
+    const size_t payload = block_size(block);
+    const size_t combined = block_size(prev) + block_header_overhead + payload;
+    controller_layout_changed(control, block);
+    memmove(block_to_ptr(prev), block_to_ptr(block), payload);
+    block_set_size(prev, combined);
+    return prev;
+}
+
+/* Mark a used block as free, coalesce it with its neighbours and insert it. */
+int controller_block_release(Controller* control, BlockHeader* block) {
+    block_mark_as_free(block);
+    if ((block = controller_block_merge_prev(control, block)) == NULL) {
+        return -1;
+    } else if ((block = controller_block_merge_next(control, block)) == NULL) {
+        return -1;
+    }
+    return controller_block_insert(control, block);
+}
+
+static int controller_quick_flush_list(Controller* control, size_t index) {
+    int released = 0;
+    BlockHeader* block = control->quick[index];
+    while (block != NULL) {
+        BlockHeader* next = block_next_free(block);
+        if (controller_block_release(control, block) != 0) {
+            control->quick[index] = block;
+            return -1;
+        }
+        control->quick_count[index]--;
+        released++;
+        block = next;
+    }
+    control->quick[index] = NULL;
+    return released;
+}
+
+/* Hold a used block of the given size on its quick-list, coalescing the list first if it is full. */
+int controller_quick_push(Controller* control, BlockHeader* block, size_t size) {
+    if (size > QUICK_LIST_SIZE_MAX) {
+        return controller_block_release(control, block);
+    }
+    const size_t index = size >> ALIGN_SIZE_LOG2;
+    if (control->quick_count[index] >= QUICK_LIST_DEPTH
+        && controller_quick_flush_list(control, index) < 0) {
+        return -1;
+    }
+    /* The block stays marked as used, so neighbours will not merge with it. */
+    block_link_next_free(block, control->quick[index]);
+    block_set_quick(block);
+    control->quick[index] = block;
+    control->quick_count[index]++;
+    return 0;
+}
+
+/* Take a block of exactly the given size from its quick-list, if any. */
+BlockHeader* controller_quick_pop(Controller* control, size_t size) {
+    if (size > QUICK_LIST_SIZE_MAX) {
+        return NULL;
+    }
+    const size_t index = size >> ALIGN_SIZE_LOG2;
+    BlockHeader* block = control->quick[index];
+    if (block != NULL) {
+        control->quick[index] = block_next_free(block);
+        control->quick_count[index]--;
+        block_link_prev_free(block, NULL);
+    }
+    return block;
+}
+
+/* Whether a used block is held on its quick-list, as it is after a free. */
+int controller_quick_holds(const Controller* control, const BlockHeader* block) {
+    if (!block_is_quick(block)) {
+        return 0;
+    }
+    /* The mark may be user data, only the list itself is certain. */
+    const size_t size = block_size(block);
+    for (const BlockHeader* entry = size > QUICK_LIST_SIZE_MAX ? NULL : control->quick[size >> ALIGN_SIZE_LOG2];
+        entry != NULL;
+        entry = block_next_free(entry)) {
+        if (entry == block) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Coalesce every quick-listed block, return the number released or -1. */
+int controller_quick_flush(Controller* control) {
+    int released = 0;
+    for (size_t i = 0; i < QUICK_LIST_COUNT; i++) {
+        if (control->quick[i] == NULL) {
+            continue;
+        }
+        const int count = controller_quick_flush_list(control, i);
+        if (count < 0) {
+            return -1;
+        }
+        released += count;
+    }
+    return released;
+}
+
 /* Trim any trailing block space off the end of a block, return to pool. */
 int controller_block_trim_free(Controller* control, BlockHeader* block, size_t size) {
     if (!block_is_free(block)) {
@@ -146,6 +322,7 @@ int controller_block_trim_free(Controller* control, BlockHeader* block, size_t s
     if (remaining_block == NULL) {
         return -1;
     }
+    controller_layout_changed(control, NULL);
     block_link_next(block);
     block_set_prev_free(remaining_block);
     return controller_block_insert(control, remaining_block);
@@ -153,8 +330,8 @@ int controller_block_trim_free(Controller* control, BlockHeader* block, size_t s
 
 /* Trim any trailing block space off the end of a used block, return to pool. */
 int controller_block_trim_used(Controller* control, BlockHeader* block, size_t size) {
-    if (!block_is_free(block)) {
-        set_alloc_errno(BLOCK_NOT_FREE);
+    if (block_is_free(block)) {
+        set_alloc_errno(BLOCK_NOT_USED);
         return -1;
     } else if (!block_can_split(block, size)) {
         return 0;
@@ -164,6 +341,7 @@ int controller_block_trim_used(Controller* control, BlockHeader* block, size_t s
     if (remaining_block == NULL) {
         return -1;
     }
+    controller_layout_changed(control, NULL);
     block_set_prev_used(remaining_block);
     if ((remaining_block = controller_block_merge_next(control, remaining_block)) == NULL) {
         return -1;
@@ -183,6 +361,7 @@ BlockHeader* controller_block_trim_free_leading(Controller* control, BlockHeader
         return block;
     }
     BlockHeader* remaining_block = block_split(block, size - block_header_overhead);
+    controller_layout_changed(control, NULL);
     block_set_prev_free(remaining_block);
     block_link_next(block);
     if (controller_block_insert(control, block) != 0) {
@@ -200,6 +379,14 @@ BlockHeader* controller_block_locate_free(Controller* control, size_t size) {
     }
     int fl = 0;
     int sl = 0;
+    BlockHeader* block = NULL;
+    if (control->fit_policy & FIT_BEST_IN_CLASS) {
+        /* Try the exact class first, it may hold a block that fits without rounding up. */
+        mapping_insert(size, &fl, &sl);
+        if (fl < FL_INDEX_COUNT && (block = controller_search_best_in_class(control, size, fl, sl)) != NULL) {
+            return controller_remove_free_block(control, block, fl, sl) == 0 ? block : NULL;
+        }
+    }
     mapping_search(size, &fl, &sl);
     /*
     ** mapping_search can futz with the size, so for excessively large sizes it can sometimes wind up
@@ -210,7 +397,6 @@ BlockHeader* controller_block_locate_free(Controller* control, size_t size) {
     if (fl >= FL_INDEX_COUNT) {
         return NULL;
     }
-    BlockHeader* block = NULL;
     if ((block = controller_search_suitable_block(control, &fl, &sl)) == NULL) {
         return block;
     } else if (block_size(block) < size) {
@@ -242,8 +428,17 @@ int controller_new(Controller* control) {
         set_alloc_errno(NULL_CONTROLLER_INSTANCE);
         return -1;
     }
-    control->block_null.prev_free = control->block_null.next_free = &control->block_null;
+    block_link_next_free(&control->block_null, &control->block_null);
+    block_link_prev_free(&control->block_null, &control->block_null);
     control->fl_bitmap = 0;
+    control->fit_policy = FIT_GOOD;
+    mapping_table_init();
+    control->deferred_coalescing = 0;
+    memset(control->quick_count, 0, sizeof(control->quick_count));
+    memset(control->quick, 0, sizeof(control->quick));
+    control->generation = 0;
+    control->free_bytes = 0;
+    memset(control->absorbed, 0, sizeof(control->absorbed));
     memset(control->sl_bitmap, 0, FL_INDEX_COUNT * sizeof(control->sl_bitmap[0]));
     for (int i = 0; i < FL_INDEX_COUNT; i++) {
         for (int j = 0; j < SL_INDEX_COUNT; j++) {
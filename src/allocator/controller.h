@@ -9,20 +9,78 @@ extern "C" {
 
 #include "block.h"
 
+/*
+** Free block selection policies, may be combined.
+** - FIT_GOOD: O(1) good-fit, take the head of the first non-empty list
+**   at or above the rounded-up size class. This is the default.
+** - FIT_BEST_IN_CLASS: scan the exact size class for the smallest block
+**   that fits before rounding up, trading O(n) list walks for less waste.
+** - FIT_ADDRESS_ORDERED: keep each free list sorted by address so that
+**   allocations favour low addresses, keeping the top of the heap free.
+*/
+typedef enum FitPolicy {
+    FIT_GOOD = 0,
+    FIT_BEST_IN_CLASS = 1 << 0,
+    FIT_ADDRESS_ORDERED = 1 << 1,
+} FitPolicy;
+
 /* The TLSF control structure. */
+/*
+** The controller leads the heap, which starts on a page boundary. State
+** touched by every malloc and free, the bitmaps, policy flags, layout
+** generation and the empty list sentinel, is packed into the first cache
+** lines. The list heads follow on their own lines, so a lookup touches
+** the bitmap lines and a single line of heads. Quick-lists and the
+** inspection log, used only by optional features, come last.
+*/
 typedef struct Controller {
+    /* Bitmaps for free lists. */
+    unsigned int fl_bitmap;
+
+    /* Combination of FitPolicy flags. */
+    unsigned int fit_policy;
+
+    /*
+    ** Deferred coalescing: recently freed small blocks stay marked as used
+    ** and are kept on exact-size quick-lists, linked through next_free and
+    ** marked by a self-link in prev_free, until reused or coalesced.
+    */
+    int deferred_coalescing;
+
+    /*
+    ** Layout generation, bumped by every split and merge of physical
+    ** blocks. The header absorbed by each recent merge, or NULL for a
+    ** split, is logged at generation % LAYOUT_LOG_COUNT so that heap
+    ** inspection can tell whether a saved position is still a block.
+    */
+    size_t generation;
+
+    /* Bytes held by blocks on the free lists, block headers excluded. */
+    size_t free_bytes;
+
     /* Empty lists point at this block to indicate they are free. */
     BlockHeader block_null;
 
-    /* Bitmaps for free lists. */
-    unsigned int fl_bitmap;
     unsigned int sl_bitmap[FL_INDEX_COUNT];
 
     /* Head of free lists. */
-    BlockHeader* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+    _Alignas(CACHE_LINE_SIZE) BlockHeader* blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+    _Alignas(CACHE_LINE_SIZE) unsigned int quick_count[QUICK_LIST_COUNT];
+    BlockHeader* quick[QUICK_LIST_COUNT];
+
+    const BlockHeader* absorbed[LAYOUT_LOG_COUNT];
 } Controller;
 
 BlockHeader* controller_search_suitable_block(Controller* control, int* fli, int* sli);
+/* Log a layout change, absorbed is the header merged away or NULL for a split. */
+void controller_layout_changed(Controller* control, const BlockHeader* absorbed);
+/* Advance the generation past the log, invalidating every saved position. */
+void controller_layout_invalidate(Controller* control);
+/* Nonzero if block is still a block header, as of the given generation. */
+int controller_layout_valid(const Controller* control, size_t generation, const BlockHeader* block);
+/* Find the smallest block of at least size within a single free list. */
+BlockHeader* controller_search_best_in_class(Controller* control, size_t size, int fl, int sl);
 /* Remove a free block from the free list.*/
 int controller_remove_free_block(Controller* control, BlockHeader* block, int fl, int sl);
 /* Insert a free block into the free block list. */
@@ -35,6 +93,18 @@ int controller_block_insert(Controller* control, BlockHeader* block);
 BlockHeader* controller_block_merge_prev(Controller* control, BlockHeader* block);
 /* Merge a just-freed block with an adjacent free block. */
 BlockHeader* controller_block_merge_next(Controller* control, BlockHeader* block);
+/* Absorb a used block into its free previous block, moving the payload down. */
+BlockHeader* controller_block_shift_into_prev(Controller* control, BlockHeader* block);
+/* Mark a used block as free, coalesce it with its neighbours and insert it. */
+int controller_block_release(Controller* control, BlockHeader* block);
+/* Hold a used block of the given size on its quick-list, coalescing the list first if it is full. */
+int controller_quick_push(Controller* control, BlockHeader* block, size_t size);
+/* Take a block of exactly the given size from its quick-list, if any. */
+BlockHeader* controller_quick_pop(Controller* control, size_t size);
+/* Whether a used block is held on its quick-list, as it is after a free. */
+int controller_quick_holds(const Controller* control, const BlockHeader* block);
+/* Coalesce every quick-listed block, return the number released or -1. */
+int controller_quick_flush(Controller* control);
 /* Trim any trailing block space off the end of a block, return to pool. */
 int controller_block_trim_free(Controller* control, BlockHeader* block, size_t size);
 /* Trim any trailing block space off the end of a used block, return to pool. */
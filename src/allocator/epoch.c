@@ -0,0 +1,299 @@
+#include "epoch.h"
+#include <sched.h>
+#include <string.h>
+
+static uint64_t epoch_sessions;
+
+/* Registration of the calling thread with the allocator it last used. */
+static __thread EpochThread* epoch_local;
+static __thread uint64_t epoch_local_session;
+
+void epoch_init(Allocator* alloc) {
+    alloc->epoch.epoch = 0;
+    alloc->epoch.threads = NULL;
+    alloc->epoch.session = __atomic_add_fetch(&epoch_sessions, 1, __ATOMIC_RELAXED);
+    alloc->epoch.discards = 0;
+    alloc->epoch.key_created = 0;
+}
+
+/*
+** Drop the calling thread's bags if the heap was reset since they were
+** last checked, returns nonzero if it was. Bags are only ever touched by
+** their owner.
+*/
+static int epoch_thread_refresh(Allocator* alloc, EpochThread* thread) {
+    const uint64_t discards = __atomic_load_n(&alloc->epoch.discards, __ATOMIC_ACQUIRE);
+    if (thread->discards == discards) {
+        return 0;
+    }
+    for (size_t i = 0; i < EPOCH_BAG_COUNT; i++) {
+        thread->bags[i].count = 0;
+    }
+    thread->discards = discards;
+    return 1;
+}
+
+static int epoch_bag_free(Allocator* alloc, EpochThread* thread, EpochBag* bag) {
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    /* Checked under the lock, so no reset can slip in before the blocks are freed. */
+    const int status = epoch_thread_refresh(alloc, thread) ? 0 : htfh_free_batch(alloc, bag->ptrs, bag->count);
+    bag->count = 0;
+    return __htfh_lock_unlock_handled(&alloc->mutex) | status;
+}
+
+/* Advance the global epoch if every active reader has announced it, returns the epoch now current. */
+static uint64_t epoch_try_advance(Allocator* alloc) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const uint64_t epoch = __atomic_load_n(&alloc->epoch.epoch, __ATOMIC_RELAXED);
+    for (EpochThread* thread = __atomic_load_n(&alloc->epoch.threads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+        const uint64_t state = __atomic_load_n(&thread->state, __ATOMIC_RELAXED);
+        if ((state & 1) && (state >> 1) != epoch) {
+            return epoch;
+        }
+    }
+    uint64_t current = epoch;
+    if (__atomic_compare_exchange_n(&alloc->epoch.epoch, &current, epoch + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return epoch + 1;
+    }
+    return current;
+}
+
+/* Try to advance the epoch and free the calling thread's bags that have become safe. */
+static int epoch_collect(Allocator* alloc, EpochThread* thread) {
+    const uint64_t epoch = epoch_try_advance(alloc);
+    int status = 0;
+    for (size_t i = 0; i < EPOCH_BAG_COUNT; i++) {
+        EpochBag* bag = &thread->bags[i];
+        if (bag->count && bag->epoch + 2 <= epoch) {
+            status |= epoch_bag_free(alloc, thread, bag);
+        }
+    }
+    return status;
+}
+
+/*
+** Key destructor for a thread exiting while still registered. The thread
+** can no longer be inside a read section, and whatever it retired and
+** could not yet free stays in its bags for the next thread to claim the
+** registration.
+*/
+static void epoch_thread_orphan(void* arg) {
+    EpochThread* thread = arg;
+    Allocator* alloc = thread->alloc;
+    thread->depth = 0;
+    __atomic_store_n(&thread->state, 0, __ATOMIC_RELEASE);
+    epoch_collect(alloc, thread);
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return;
+    }
+    __atomic_store_n(&thread->in_use, 0, __ATOMIC_RELEASE);
+    __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+/* Claim a released registration or add a new one, the caller must hold the allocator lock. */
+static EpochThread* epoch_thread_claim(Allocator* alloc) {
+    if (!alloc->epoch.key_created) {
+        if (pthread_key_create(&alloc->epoch.key, epoch_thread_orphan) != 0) {
+            set_alloc_errno(EPOCH_STATE_FAILED);
+            return NULL;
+        }
+        __atomic_store_n(&alloc->epoch.key_created, 1, __ATOMIC_RELEASE);
+    }
+    EpochThread* thread = alloc->epoch.threads;
+    while (thread != NULL && __atomic_load_n(&thread->in_use, __ATOMIC_RELAXED)) {
+        thread = thread->next;
+    }
+    if (thread == NULL) {
+        /* Kept on a line of its own, advancing threads read every state. */
+        thread = aligned_alloc(CACHE_LINE_SIZE, align_up(sizeof(*thread), CACHE_LINE_SIZE));
+        if (thread == NULL) {
+            set_alloc_errno(EPOCH_STATE_FAILED);
+            return NULL;
+        }
+        memset(thread, 0, sizeof(*thread));
+        thread->next = alloc->epoch.threads;
+        __atomic_store_n(&alloc->epoch.threads, thread, __ATOMIC_RELEASE);
+    }
+    if (pthread_setspecific(alloc->epoch.key, thread) != 0) {
+        set_alloc_errno(EPOCH_STATE_FAILED);
+        return NULL;
+    }
+    thread->alloc = alloc;
+    __atomic_store_n(&thread->in_use, 1, __ATOMIC_RELEASE);
+    return thread;
+}
+
+/* Registration of the calling thread, claimed if create is set, NULL if it has none. */
+static EpochThread* epoch_thread(Allocator* alloc, int create) {
+    if (epoch_local_session == alloc->epoch.session) {
+        return epoch_local;
+    }
+    /* The thread may be using several allocators in turn. */
+    EpochThread* thread = __atomic_load_n(&alloc->epoch.key_created, __ATOMIC_ACQUIRE)
+        ? pthread_getspecific(alloc->epoch.key)
+        : NULL;
+    if (thread == NULL && create) {
+        if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+            return NULL;
+        }
+        thread = epoch_thread_claim(alloc);
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return NULL;
+        }
+    }
+    if (thread != NULL) {
+        epoch_local = thread;
+        epoch_local_session = alloc->epoch.session;
+    }
+    return thread;
+}
+
+int htfh_epoch_enter(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    }
+    EpochThread* thread = epoch_thread(alloc, 1);
+    if (thread == NULL) {
+        return -1;
+    } else if (thread->depth++ == 0) {
+        const uint64_t epoch = __atomic_load_n(&alloc->epoch.epoch, __ATOMIC_RELAXED);
+        __atomic_store_n(&thread->state, (epoch << 1) | 1, __ATOMIC_RELAXED);
+        /* Orders the announcement before every read the section makes. */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+int htfh_epoch_exit(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    }
+    EpochThread* thread = epoch_thread(alloc, 0);
+    if (thread == NULL || thread->depth == 0) {
+        set_alloc_errno(EPOCH_NOT_ENTERED);
+        return -1;
+    } else if (--thread->depth == 0) {
+        /* Orders every read the section made before the exit is seen. */
+        __atomic_store_n(&thread->state, thread->state & ~(uint64_t) 1, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+int htfh_free_deferred(Allocator* alloc, void* ptr) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (ptr == NULL) {
+        return 0;
+    }
+    EpochThread* thread = epoch_thread(alloc, 1);
+    if (thread == NULL) {
+        return -1;
+    }
+    int status = 0;
+    epoch_thread_refresh(alloc, thread);
+    const uint64_t epoch = __atomic_load_n(&alloc->epoch.epoch, __ATOMIC_ACQUIRE);
+    EpochBag* bag = &thread->bags[epoch % EPOCH_BAG_COUNT];
+    if (bag->epoch != epoch) {
+        /* Anything left in the bag was retired at least EPOCH_BAG_COUNT epochs ago. */
+        status |= epoch_bag_free(alloc, thread, bag);
+        bag->epoch = epoch;
+    }
+    if (bag->count == bag->capacity) {
+        const size_t capacity = bag->capacity ? bag->capacity * 2 : EPOCH_BATCH_SIZE;
+        void** ptrs = realloc(bag->ptrs, capacity * sizeof(void*));
+        if (ptrs == NULL) {
+            set_alloc_errno(EPOCH_STATE_FAILED);
+            return -1;
+        }
+        bag->ptrs = ptrs;
+        bag->capacity = capacity;
+    }
+    bag->ptrs[bag->count++] = ptr;
+    if (bag->count % EPOCH_BATCH_SIZE == 0) {
+        status |= epoch_collect(alloc, thread);
+    }
+    return status;
+}
+
+int htfh_epoch_synchronize(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    }
+    EpochThread* thread = epoch_thread(alloc, 0);
+    if (thread == NULL) {
+        return 0;
+    } else if (thread->depth != 0) {
+        set_alloc_errno(EPOCH_READER_ACTIVE);
+        return -1;
+    }
+    int status = 0;
+    epoch_thread_refresh(alloc, thread);
+    for (;;) {
+        status |= epoch_collect(alloc, thread);
+        size_t pending = 0;
+        for (size_t i = 0; i < EPOCH_BAG_COUNT; i++) {
+            pending += thread->bags[i].count;
+        }
+        if (!pending) {
+            return status;
+        }
+        /* Readers still inside a section must run to leave it. */
+        sched_yield();
+    }
+}
+
+int htfh_epoch_thread_exit(Allocator* alloc) {
+    if (htfh_epoch_synchronize(alloc) != 0 && alloc_errno == EPOCH_READER_ACTIVE) {
+        return -1;
+    }
+    EpochThread* thread = epoch_thread(alloc, 0);
+    if (thread == NULL) {
+        return 0;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < EPOCH_BAG_COUNT; i++) {
+        free(thread->bags[i].ptrs);
+        memset(&thread->bags[i], 0, sizeof(thread->bags[i]));
+    }
+    __atomic_store_n(&thread->in_use, 0, __ATOMIC_RELEASE);
+    epoch_local = NULL;
+    epoch_local_session = 0;
+    const int status = pthread_setspecific(alloc->epoch.key, NULL);
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (status != 0) {
+        set_alloc_errno(EPOCH_STATE_FAILED);
+        return -1;
+    }
+    return 0;
+}
+
+void epoch_discard(Allocator* alloc) {
+    /* Owners may be filling their bags right now, each drops its own on its next call. */
+    __atomic_add_fetch(&alloc->epoch.discards, 1, __ATOMIC_RELEASE);
+}
+
+void epoch_destroy(Allocator* alloc) {
+    EpochThread* thread = alloc->epoch.threads;
+    while (thread != NULL) {
+        EpochThread* next = thread->next;
+        for (size_t i = 0; i < EPOCH_BAG_COUNT; i++) {
+            free(thread->bags[i].ptrs);
+        }
+        free(thread);
+        thread = next;
+    }
+    alloc->epoch.threads = NULL;
+    if (alloc->epoch.key_created) {
+        /* Threads still registered no longer run the destructor. */
+        pthread_key_delete(alloc->epoch.key);
+        alloc->epoch.key_created = 0;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_EPOCH_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_EPOCH_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "htfh.h"
+
+/*
+** Epoch-based deferred free for lock-free readers.
+**
+** Readers of a lock-free structure living on the heap bracket every
+** traversal with htfh_epoch_enter and htfh_epoch_exit. A writer that
+** unlinks a node hands it to htfh_free_deferred instead of htfh_free.
+** The node is then freed once every reader that could still hold a
+** pointer to it has left its read section.
+**
+** The allocator keeps a global epoch. Entering a read section announces
+** the epoch the reader observed, and the epoch advances only once every
+** reader inside a section has announced the current one. A block retired
+** in epoch e can no longer be reached once the epoch reaches e + 2.
+**
+** Retired blocks are gathered in bags owned by the retiring thread, one
+** per epoch still in flight, so retiring takes no lock. Every
+** EPOCH_BATCH_SIZE retirements the thread tries to advance the epoch and
+** releases its bags that have become safe with a single htfh_free_batch.
+** A reader stalled inside a section holds back every thread's bags.
+**
+** Read sections nest, and a thread may retire from inside one. Threads
+** register with an allocator on first use. A thread that is done with an
+** allocator calls htfh_epoch_thread_exit, which waits for its retired
+** blocks to be freed and releases its registration for reuse. A thread
+** that exits without doing so has its registration released by a thread
+** key destructor, and the blocks it left retired are freed by the next
+** thread to claim the registration. Blocks still retired when the
+** allocator is reset or destroyed are dropped, each thread dropping its
+** own bags the next time it retires.
+*/
+
+/* Retirements between attempts to advance the epoch and free safe bags. */
+#define EPOCH_BATCH_SIZE 64
+/* Bags per thread, enough for the epochs a retired block may wait through. */
+#define EPOCH_BAG_COUNT 3
+
+typedef struct EpochBag {
+    void** ptrs;
+    size_t count;
+    size_t capacity;
+    /* Epoch the blocks were retired in. */
+    uint64_t epoch;
+} EpochBag;
+
+typedef struct EpochThread {
+    /* Epoch announced on entry shifted left by one, the low bit set while inside a read section. */
+    uint64_t state;
+    /* Nesting depth of read sections, only touched by the owner. */
+    unsigned int depth;
+    /* Claimed by a thread, changed under the allocator lock. */
+    int in_use;
+    /* Value of the allocator's discard count the bags were last checked against. */
+    uint64_t discards;
+    Allocator* alloc;
+    EpochBag bags[EPOCH_BAG_COUNT];
+    struct EpochThread* next;
+} EpochThread;
+
+/* Enter a read section, blocks retired from now on stay allocated until it is left. */
+int htfh_epoch_enter(Allocator* alloc);
+/* Leave the innermost read section entered by the calling thread. */
+int htfh_epoch_exit(Allocator* alloc);
+/* Free ptr once no reader can still reach it, NULL is ignored. */
+int htfh_free_deferred(Allocator* alloc, void* ptr);
+/*
+** Wait until every block retired by the calling thread has been freed.
+** Fails if the calling thread is inside a read section.
+*/
+int htfh_epoch_synchronize(Allocator* alloc);
+/* Synchronize and release the calling thread's registration with the allocator. */
+int htfh_epoch_thread_exit(Allocator* alloc);
+
+/* Set up the epoch state of a newly initialised allocator. */
+void epoch_init(Allocator* alloc);
+/* Drop every retired block, for a heap that has been reset. The caller must hold the lock. */
+void epoch_discard(Allocator* alloc);
+/* Release all thread registrations, for an allocator being destroyed. */
+void epoch_destroy(Allocator* alloc);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_EPOCH_
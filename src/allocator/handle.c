@@ -0,0 +1,246 @@
+#include "handle.h"
+
+#define HANDLE_TABLE_CAPACITY_MIN 64
+
+static inline htfh_handle_t handle_make(uint32_t index, uint32_t generation) {
+    return ((htfh_handle_t) generation << 32) | (htfh_handle_t) (index + 1);
+}
+
+/* Resolve a handle to its live entry, the caller must hold the allocator mutex. */
+static HandleEntry* handle_entry(HandleTable* table, htfh_handle_t handle) {
+    const uint32_t index = (uint32_t) handle - 1;
+    if ((uint32_t) handle == 0 || index >= table->capacity) {
+        set_alloc_errno(INVALID_HANDLE);
+        return NULL;
+    }
+    HandleEntry* entry = &table->entries[index];
+    if (entry->ptr == NULL || entry->generation != (uint32_t) (handle >> 32)) {
+        set_alloc_errno(INVALID_HANDLE);
+        return NULL;
+    }
+    return entry;
+}
+
+/* Double the entry array and chain the new entries onto the unused list. */
+static int handle_table_grow(HandleTable* table) {
+    const uint32_t capacity = table->capacity ? table->capacity * 2 : HANDLE_TABLE_CAPACITY_MIN;
+    if (capacity <= table->capacity) {
+        set_alloc_errno(HEAP_FULL);
+        return -1;
+    }
+    HandleEntry* entries = htfh_realloc(table->alloc, table->entries, capacity * sizeof(HandleEntry));
+    if (entries == NULL) {
+        return -1;
+    }
+    for (uint32_t i = table->capacity; i < capacity; i++) {
+        entries[i].ptr = NULL;
+        entries[i].generation = 0;
+        entries[i].pins = 0;
+        entries[i].next_free = i + 1 < capacity ? i + 2 : table->free_head;
+    }
+    table->free_head = table->capacity + 1;
+    table->entries = entries;
+    table->capacity = capacity;
+    return 0;
+}
+
+/*
+** Move the block of an entry down into the free block preceding it. The
+** freed space is split off behind the moved block and coalesced with its
+** next neighbour. Returns 1 and adds the bytes moved to moved_bytes if the
+** block moved, 0 if it cannot move and -1 on error.
+*/
+static int handle_compact_entry(HandleTable* table, HandleEntry* entry, size_t* moved_bytes) {
+    if (entry->ptr == NULL || entry->pins > 0) {
+        return 0;
+    }
+    Controller* control = table->alloc->controller;
+    BlockHeader* block = block_from_ptr(entry->ptr);
+    if (block_is_mapped(block) || !block_is_prev_free(block)) {
+        return 0;
+    }
+    const size_t size = block_size(block);
+    if ((block = controller_block_shift_into_prev(control, block)) == NULL
+        || block_mark_as_used(block) != 0
+        || controller_block_trim_used(control, block, size) != 0) {
+        return -1;
+    }
+    entry->ptr = block_to_ptr(block);
+    *moved_bytes += size;
+    return 1;
+}
+
+HandleTable* htfh_handles_create(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    }
+    HandleTable* table = htfh_malloc(alloc, sizeof(*table));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->alloc = alloc;
+    table->entries = NULL;
+    table->capacity = 0;
+    table->free_head = 0;
+    table->cursor = 0;
+    return table;
+}
+
+int htfh_handles_destroy(HandleTable* table) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    int status = 0;
+    for (uint32_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].ptr != NULL && htfh_free(alloc, table->entries[i].ptr) != 0) {
+            status = -1;
+        }
+    }
+    if (table->entries != NULL && htfh_free(alloc, table->entries) != 0) {
+        status = -1;
+    }
+    if (htfh_free(alloc, table) != 0) {
+        status = -1;
+    }
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? status : -1;
+}
+
+htfh_handle_t htfh_halloc(HandleTable* table, size_t size) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return HTFH_HANDLE_NULL;
+    } else if (!size) {
+        set_alloc_errno(NON_ZERO_BLOCK_SIZE);
+        return HTFH_HANDLE_NULL;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return HTFH_HANDLE_NULL;
+    } else if (table->free_head == 0 && handle_table_grow(table) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return HTFH_HANDLE_NULL;
+    }
+    void* ptr = htfh_malloc(alloc, size);
+    if (ptr == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return HTFH_HANDLE_NULL;
+    }
+    const uint32_t index = table->free_head - 1;
+    HandleEntry* entry = &table->entries[index];
+    table->free_head = entry->next_free;
+    entry->ptr = ptr;
+    entry->pins = 0;
+    entry->next_free = 0;
+    const htfh_handle_t handle = handle_make(index, entry->generation);
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? handle : HTFH_HANDLE_NULL;
+}
+
+int htfh_hfree(HandleTable* table, htfh_handle_t handle) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    HandleEntry* entry = handle_entry(table, handle);
+    if (entry == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (entry->pins > 0) {
+        set_alloc_errno(HANDLE_PINNED);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (htfh_free(alloc, entry->ptr) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    entry->ptr = NULL;
+    entry->generation++;
+    entry->next_free = table->free_head;
+    table->free_head = (uint32_t) (entry - table->entries) + 1;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+void* htfh_hpin(HandleTable* table, htfh_handle_t handle) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return NULL;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return NULL;
+    }
+    HandleEntry* entry = handle_entry(table, handle);
+    void* ptr = NULL;
+    if (entry != NULL) {
+        entry->pins++;
+        ptr = entry->ptr;
+    }
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? ptr : NULL;
+}
+
+int htfh_hunpin(HandleTable* table, htfh_handle_t handle) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    HandleEntry* entry = handle_entry(table, handle);
+    if (entry == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (entry->pins == 0) {
+        set_alloc_errno(HANDLE_NOT_PINNED);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    entry->pins--;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_compact(HandleTable* table, size_t max_bytes) {
+    if (table == NULL) {
+        set_alloc_errno(NULL_HANDLE_TABLE_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = table->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    /* Quick-listed blocks are marked used and would hide the gaps they leave. */
+    const int flushed = alloc->controller->deferred_coalescing
+        ? controller_quick_flush(alloc->controller)
+        : 0;
+    uint32_t remaining = table->capacity;
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0 || flushed < 0) {
+        return -1;
+    }
+    int moved = 0;
+    size_t moved_bytes = 0;
+    while (remaining-- > 0 && moved_bytes < max_bytes) {
+        if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+            return -1;
+        }
+        /* The table may have grown while the mutex was released. */
+        if (table->cursor >= table->capacity) {
+            table->cursor = 0;
+        }
+        const int status = handle_compact_entry(table, &table->entries[table->cursor++], &moved_bytes);
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0 || status < 0) {
+            return -1;
+        }
+        moved += status;
+    }
+    return moved;
+}
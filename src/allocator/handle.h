@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_HANDLE_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_HANDLE_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "htfh.h"
+
+/*
+** Movable allocations referenced through handles.
+**
+** A handle names an entry in a table that holds the current address of
+** its block, so the block may be relocated by htfh_compact while the
+** handle stays valid. Raw access is obtained with htfh_hpin, which keeps
+** the block in place until the matching htfh_hunpin; a pointer must not
+** be used once its pin is released. The low half of a handle is the
+** entry index plus one and the high half a generation that is bumped on
+** every free, so stale handles are rejected. Every operation runs under
+** the allocator mutex.
+*/
+typedef uint64_t htfh_handle_t;
+
+#define HTFH_HANDLE_NULL ((htfh_handle_t) 0)
+
+typedef struct HandleEntry {
+    /* Payload of the block, NULL while the entry is unused. */
+    void* ptr;
+    uint32_t generation;
+    uint32_t pins;
+    /* Next unused entry index plus one, 0 ends the list. */
+    uint32_t next_free;
+} HandleEntry;
+
+typedef struct HandleTable {
+    Allocator* alloc;
+    HandleEntry* entries;
+    uint32_t capacity;
+    /* First unused entry index plus one, 0 if the table is full. */
+    uint32_t free_head;
+    /* Entry the next compaction step starts from. */
+    uint32_t cursor;
+} HandleTable;
+
+HandleTable* htfh_handles_create(Allocator* alloc);
+/* Free every live handle's block and the table itself. */
+int htfh_handles_destroy(HandleTable* table);
+
+htfh_handle_t htfh_halloc(HandleTable* table, size_t size);
+/* Free the block of an unpinned handle, the handle becomes invalid. */
+int htfh_hfree(HandleTable* table, htfh_handle_t handle);
+
+/* Pins nest, the block does not move while any pin is held. */
+void* htfh_hpin(HandleTable* table, htfh_handle_t handle);
+int htfh_hunpin(HandleTable* table, htfh_handle_t handle);
+
+/*
+** Slide unpinned handle blocks that follow a free block down into it,
+** moving the free space towards the end of the heap where it coalesces.
+** Each step relocates a single block under the allocator mutex, which is
+** released between steps. The call stops once max_bytes have been moved
+** or every handle has been visited, and resumes where it left off on the
+** next call. Returns the number of blocks moved, or -1 on error.
+*/
+int htfh_compact(HandleTable* table, size_t max_bytes);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_HANDLE_
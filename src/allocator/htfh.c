@@ -1,28 +1,24 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "htfh.h"
+#include "verify.h"
+#include "trace.h"
+#include "pressure.h"
+#include "epoch.h"
+#include "stats.h"
 #include <stddef.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
 #include <assert.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-#define __htfh_lock_lock_handled(lock) ({ \
-    int _lock_result = 0; \
-    if (__htfh_lock_lock(lock) == EINVAL) { \
-        set_alloc_errno_msg(MUTEX_LOCK_LOCK, strerror(EINVAL)); \
-        _lock_result = -1; \
-    } \
-    _lock_result; \
-})
-
-#define __htfh_lock_unlock_handled(lock) ({ \
-    int _unlock_result = 0; \
-    if ((_unlock_result = __htfh_lock_unlock(lock)) != 0) { \
-        set_alloc_errno_msg(MUTEX_LOCK_UNLOCK, strerror(_unlock_result)); \
-        _unlock_result = -1; \
-    } \
-    _unlock_result; \
-})
+__thread unsigned int __htfh_lock_depth = 0;
 
 static size_t adjust_request_size(size_t size, size_t align) {
     size_t adjust = 0;
@@ -36,6 +32,104 @@ static size_t adjust_request_size(size_t size, size_t align) {
     return adjust;
 }
 
+// ==== DIRECT MAPPING ====
+
+static inline int use_mapping(const Allocator* alloc, size_t size) {
+    return alloc->mmap_threshold != 0 && size >= alloc->mmap_threshold;
+}
+
+/* Largest size a direct mapping can hold without its length wrapping or overflowing the size field. */
+static size_t mapped_size_max(void) {
+    const size_t limit = htfh_min(block_mapped_size_max, SIZE_MAX - block_start_offset) + block_start_offset;
+    return align_down(limit, (size_t) sysconf(_SC_PAGESIZE)) - block_start_offset;
+}
+
+static size_t mapped_length(size_t size) {
+    return align_up(size + block_start_offset, (size_t) sysconf(_SC_PAGESIZE));
+}
+
+static void* mapped_block_create(size_t size) {
+    if (size > mapped_size_max()) {
+        set_alloc_errno(MAPPED_BLOCK_TOO_LARGE);
+        return NULL;
+    }
+    const size_t length = mapped_length(size);
+    void* mem = mmap(
+        NULL,
+        length,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+    if (mem == MAP_FAILED) {
+        set_alloc_errno_msg(BLOCK_MMAP_FAILED, strerror(errno));
+        return NULL;
+    }
+    BlockHeader* block = mem;
+    block->size = 0;
+    block_set_size(block, length - block_start_offset);
+    block_set_mapped(block);
+    return block_to_ptr(block);
+}
+
+static int mapped_block_destroy(BlockHeader* block) {
+    if (munmap(block, block_size(block) + block_start_offset) != 0) {
+        set_alloc_errno_msg(BLOCK_MUNMAP_FAILED, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+** Resize a direct-mapped block. With mremap the page tables are moved
+** rather than the contents copied. The block is only relocated if
+** may_move is set, otherwise the resize fails when it cannot be done in
+** place.
+*/
+static BlockHeader* mapped_block_resize(BlockHeader* block, size_t size, int may_move) {
+    if (size > mapped_size_max()) {
+        set_alloc_errno(MAPPED_BLOCK_TOO_LARGE);
+        return NULL;
+    }
+    const size_t old_length = block_size(block) + block_start_offset;
+    const size_t new_length = mapped_length(size);
+    if (new_length == old_length) {
+        return block;
+    }
+#if defined(MREMAP_MAYMOVE)
+    void* mem = mremap(block, old_length, new_length, may_move ? MREMAP_MAYMOVE : 0);
+    if (mem == MAP_FAILED) {
+        set_alloc_errno_msg(BLOCK_MREMAP_FAILED, strerror(errno));
+        return NULL;
+    }
+    block = mem;
+#else
+    if (new_length < old_length) {
+        /* Shrinking only needs the tail pages to be released. */
+        if (munmap((char*) block + new_length, old_length - new_length) != 0) {
+            set_alloc_errno_msg(BLOCK_MUNMAP_FAILED, strerror(errno));
+            return NULL;
+        }
+    } else if (!may_move) {
+        set_alloc_errno(CANNOT_EXPAND_BLOCK);
+        return NULL;
+    } else {
+        void* ptr = mapped_block_create(size);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        memcpy(ptr, block_to_ptr(block), block_size(block));
+        mapped_block_destroy(block);
+        return block_from_ptr(ptr);
+    }
+#endif
+    block_set_size(block, new_length - block_start_offset);
+    return block;
+}
+
+// ==== ALLOCATOR ====
+
 inline size_t htfh_size(void) {
     return sizeof(Controller);
 }
@@ -60,12 +154,195 @@ inline size_t htfh_alloc_overhead(void) {
     return block_header_overhead;
 }
 
+/* Caller parked in htfh_malloc_wait, lives on the caller's stack. */
+typedef struct HeapWaiter {
+    pthread_cond_t cond;
+    /* Free list a block must be indexed at or above to satisfy the request. */
+    int fl;
+    int sl;
+    struct HeapWaiter* next;
+} HeapWaiter;
+
+/* Wake the first waiter if a free block of the given size could satisfy it. */
+static void wake_waiter(Allocator* alloc, size_t size) {
+    HeapWaiter* waiter = alloc->waiters;
+    if (waiter == NULL) {
+        return;
+    }
+    int fl;
+    int sl;
+    mapping_insert(size, &fl, &sl);
+    if (fl > waiter->fl || (fl == waiter->fl && sl >= waiter->sl)) {
+        pthread_cond_signal(&waiter->cond);
+    }
+}
+
+/* Index of the last registered pool starting at or below addr, -1 if none. */
+static ptrdiff_t pool_search(const Allocator* alloc, const void* addr) {
+    size_t low = 0;
+    size_t high = alloc->pool_count;
+    while (low < high) {
+        const size_t mid = low + (high - low) / 2;
+        if ((uintptr_t) alloc->pools[mid].start <= (uintptr_t) addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (ptrdiff_t) low - 1;
+}
+
+/* Bytes of a pool of the given size left for blocks. */
+static inline size_t pool_usable_bytes(size_t bytes) {
+    return align_down(bytes - htfh_pool_overhead(), ALIGN_SIZE);
+}
+
+/* Insert a pool into the sorted registry, the caller must hold the lock. */
+static int pool_register(Allocator* alloc, char* mem, size_t bytes) {
+    if (alloc->pool_count >= POOL_COUNT_MAX) {
+        set_alloc_errno(POOL_LIMIT_REACHED);
+        return -1;
+    }
+    const size_t index = (size_t) (pool_search(alloc, mem) + 1);
+    if ((index > 0 && alloc->pools[index - 1].start + alloc->pools[index - 1].bytes > mem)
+        || (index < alloc->pool_count && (size_t) (alloc->pools[index].start - mem) < bytes)) {
+        set_alloc_errno(POOL_OVERLAP);
+        return -1;
+    }
+    memmove(&alloc->pools[index + 1], &alloc->pools[index], (alloc->pool_count - index) * sizeof(HeapPool));
+    alloc->pools[index].start = mem;
+    alloc->pools[index].bytes = bytes;
+    alloc->pool_count++;
+    __atomic_add_fetch(&alloc->pool_bytes, pool_usable_bytes(bytes), __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void pool_unregister(Allocator* alloc, size_t index) {
+    __atomic_sub_fetch(&alloc->pool_bytes, pool_usable_bytes(alloc->pools[index].bytes), __ATOMIC_RELAXED);
+    alloc->pool_count--;
+    memmove(&alloc->pools[index], &alloc->pools[index + 1], (alloc->pool_count - index) * sizeof(HeapPool));
+}
+
+/* Insert a pool's memory as a single free block followed by a sentinel. */
+static int pool_insert_block(Allocator* alloc, void* mem, size_t pool_bytes) {
+    BlockHeader* block = offset_to_block(mem, -(ptrdiff_t) block_header_overhead);
+    block_set_size(block, pool_bytes);
+    block_set_free(block);
+    block_set_prev_used(block);
+    if (controller_block_insert(alloc->controller, block) != 0) {
+        return -1;
+    }
+
+    BlockHeader* next = block_link_next(block);
+    block_set_size(next, 0);
+    block_set_used(next);
+    block_set_prev_free(next);
+    return 0;
+}
+
+/* Heap bytes prefaulted by each thread, the slice a single thread fills in well under a millisecond. */
+#define PREFAULT_SLICE_MIN (16 * 1024 * 1024)
+#define PREFAULT_THREAD_MAX 16
+
+typedef struct PrefaultSlice {
+    char* start;
+    size_t bytes;
+    size_t page_size;
+} PrefaultSlice;
+
+/* Fault in every page of a slice for writing, without changing its contents. */
+static void* prefault_slice(void* arg) {
+    const PrefaultSlice* slice = arg;
+#if defined(MADV_POPULATE_WRITE)
+    if (madvise(slice->start, slice->bytes, MADV_POPULATE_WRITE) == 0) {
+        return NULL;
+    }
+#endif
+    for (size_t offset = 0; offset < slice->bytes; offset += slice->page_size) {
+        volatile char* page = slice->start + offset;
+        *page = *page;
+    }
+    return NULL;
+}
+
+/*
+** Make memory resident before locking it, splitting the work across
+** threads so large heaps are not faulted in one page at a time. mlock
+** would fault the pages in as well, but from a single thread.
+*/
+static int memory_pin(void* mem, size_t bytes) {
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    char* const start = (char*) align_down((uintptr_t) mem, page_size);
+    const size_t length = align_up((size_t) ((char*) mem + bytes - start), page_size);
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = htfh_min(length / PREFAULT_SLICE_MIN, (size_t) PREFAULT_THREAD_MAX);
+    thread_count = htfh_max(htfh_min(thread_count, cpus > 0 ? (size_t) cpus : 1), (size_t) 1);
+    const size_t slice_bytes = align_up(length / thread_count, page_size);
+    PrefaultSlice slices[PREFAULT_THREAD_MAX];
+    pthread_t threads[PREFAULT_THREAD_MAX];
+    int started[PREFAULT_THREAD_MAX];
+    for (size_t i = 0; i < thread_count; i++) {
+        const size_t offset = i * slice_bytes;
+        slices[i].start = start + offset;
+        slices[i].bytes = i + 1 < thread_count ? slice_bytes : length - offset;
+        slices[i].page_size = page_size;
+        /* The first slice is faulted by the caller, as is any whose thread cannot start. */
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, prefault_slice, &slices[i]) == 0;
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        if (!started[i]) {
+            prefault_slice(&slices[i]);
+        }
+    }
+    for (size_t i = 1; i < thread_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    if (mlock(start, length) != 0) {
+        set_alloc_errno_msg(HEAP_LOCK_FAILED, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void memory_unpin(void* mem, size_t bytes) {
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    char* const start = (char*) align_down((uintptr_t) mem, page_size);
+    munlock(start, align_up((size_t) ((char*) mem + bytes - start), page_size));
+}
+
+/* Nonzero if a pool lies within the allocator's own heap, which is pinned as a whole. */
+static inline int pool_in_heap(const Allocator* alloc, const void* mem) {
+    return (const char*) mem >= (const char*) alloc->heap
+        && (const char*) mem < (const char*) alloc->heap + alloc->heap_size;
+}
+
+/*
+** Nonzero if every block of a pool can link to every other block and to
+** block_null. Always the case unless block headers are compact.
+*/
+static int pool_in_link_span(const Allocator* alloc, const void* mem, size_t bytes) {
+#ifdef HTFH_COMPACT_HEADERS
+    const uintptr_t control = (uintptr_t) alloc->controller;
+    const uintptr_t start = (uintptr_t) mem;
+    const uintptr_t end = start + bytes;
+    return (start >= control || control - start <= BLOCK_LINK_SPAN_MAX)
+        && (end <= control || end - control <= BLOCK_LINK_SPAN_MAX);
+#else
+    (void) alloc;
+    (void) mem;
+    (void) bytes;
+    return 1;
+#endif
+}
+
 void* htfh_add_pool(Allocator* alloc, void* mem, size_t bytes) {
     if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
         return NULL;
     }
     const size_t pool_overhead = htfh_pool_overhead();
-    const size_t pool_bytes = align_down(bytes - pool_overhead, ALIGN_SIZE);
+    const size_t pool_bytes = pool_usable_bytes(bytes);
     if (((ptrdiff_t) mem % ALIGN_SIZE) != 0) {
         set_alloc_errno(POOL_MISALIGNED);
         __htfh_lock_unlock_handled(&alloc->mutex);
@@ -86,27 +363,89 @@ void* htfh_add_pool(Allocator* alloc, void* mem, size_t bytes) {
         set_alloc_errno_msg(INVALID_POOL_SIZE, msg);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return NULL;
+    } else if (!pool_in_link_span(alloc, mem, bytes)) {
+        set_alloc_errno(POOL_OUT_OF_RANGE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return NULL;
     }
-    BlockHeader* block = offset_to_block(mem, -(ptrdiff_t) block_header_overhead);
-    block_set_size(block, pool_bytes);
-    block_set_free(block);
-    block_set_prev_used(block);
-    if (controller_block_insert(alloc->controller, block) != 0) {
+    const int pin = alloc->realtime && !pool_in_heap(alloc, mem);
+    if (pool_register(alloc, mem, bytes) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return NULL;
+    } else if (pin && memory_pin(mem, bytes) != 0) {
+        pool_unregister(alloc, (size_t) pool_search(alloc, mem));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return NULL;
+    } else if (pool_insert_block(alloc, mem, pool_bytes) != 0) {
+        if (pin) {
+            memory_unpin(mem, bytes);
+        }
+        pool_unregister(alloc, (size_t) pool_search(alloc, mem));
         __htfh_lock_unlock_handled(&alloc->mutex);
         return NULL;
     }
-
-    BlockHeader* next = block_link_next(block);
-    block_set_size(next, 0);
-    block_set_used(next);
-    block_set_prev_free(next);
-
+    wake_waiter(alloc, pool_bytes);
     if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
         return NULL;
     }
     return mem;
 }
 
+int htfh_remove_pool(Allocator* alloc, void* pool) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    const ptrdiff_t index = pool_search(alloc, pool);
+    if (index < 0 || alloc->pools[index].start != pool) {
+        set_alloc_errno(POOL_NOT_FOUND);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (alloc->controller->deferred_coalescing && controller_quick_flush(alloc->controller) < 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    /* An unused pool has coalesced back into a single free block before the sentinel. */
+    BlockHeader* block = offset_to_block(pool, -(ptrdiff_t) block_header_overhead);
+    if (!block_is_free(block) || !block_is_last(block_next(block))) {
+        set_alloc_errno(POOL_IN_USE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (controller_block_remove(alloc->controller, block) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    if (alloc->realtime && !pool_in_heap(alloc, pool)) {
+        memory_unpin(pool, alloc->pools[index].bytes);
+    }
+    pool_unregister(alloc, (size_t) index);
+    controller_layout_invalidate(alloc->controller);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+void* htfh_get_pool(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    }
+    return (char*) alloc->heap + htfh_size();
+}
+
+int htfh_owns(Allocator* alloc, const void* ptr) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return 0;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return 0;
+    }
+    const ptrdiff_t index = pool_search(alloc, ptr);
+    const int owned = index >= 0
+        && (size_t) ((const char*) ptr - alloc->pools[index].start) < alloc->pools[index].bytes;
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 && owned;
+}
+
 #if _DEBUG
 int test_ffs_fls() {
 	/* Verify ffs/fls work properly. */
@@ -131,7 +470,81 @@ int test_ffs_fls() {
 }
 #endif
 
+/* Map the heap, backed by a memfd if requested. Returns MAP_FAILED on error. */
+static void* heap_map(Allocator* alloc, size_t bytes, unsigned int flags) {
+    alloc->heap_fd = -1;
+    if (!(flags & HTFH_CREATE_MEMFD)) {
+        return mmap(
+            NULL,
+            bytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0
+        );
+    }
+#if defined(MFD_CLOEXEC)
+    if ((alloc->heap_fd = memfd_create("htfh_heap", MFD_CLOEXEC)) == -1) {
+        set_alloc_errno_msg(HEAP_MEMFD_FAILED, strerror(errno));
+        return MAP_FAILED;
+    } else if (ftruncate(alloc->heap_fd, (off_t) align_up(bytes, (size_t) sysconf(_SC_PAGESIZE))) != 0) {
+        set_alloc_errno_msg(HEAP_MEMFD_FAILED, strerror(errno));
+        close(alloc->heap_fd);
+        return MAP_FAILED;
+    }
+    void* heap = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, alloc->heap_fd, 0);
+    if (heap == MAP_FAILED) {
+        close(alloc->heap_fd);
+    }
+    return heap;
+#else
+    set_alloc_errno_msg(HEAP_MEMFD_FAILED, "memfd_create is not available");
+    return MAP_FAILED;
+#endif
+}
+
 Allocator* htfh_create(size_t bytes) {
+    return htfh_create_flags(bytes, 0);
+}
+
+/* Initialise the mutex, controller and primary pool over a reserved heap. */
+static int allocator_init(Allocator* alloc, void* heap, size_t bytes, unsigned int flags) {
+    int lock_result;
+    const int protocol = flags & HTFH_CREATE_REALTIME ? PTHREAD_PRIO_INHERIT : PTHREAD_PRIO_NONE;
+    if ((lock_result = __htfh_lock_init_protocol(&alloc->mutex, PTHREAD_MUTEX_RECURSIVE, protocol)) != 0) {
+        set_alloc_errno_msg(MUTEX_LOCK_INIT, strerror(lock_result));
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    alloc->heap_size = bytes;
+    alloc->realtime = (flags & HTFH_CREATE_REALTIME) != 0;
+    alloc->mmap_threshold = alloc->realtime ? 0 : HTFH_MMAP_THRESHOLD;
+    alloc->snapshot = NULL;
+    alloc->pool_count = 0;
+    alloc->pool_bytes = 0;
+    memset(&alloc->pressure, 0, sizeof(alloc->pressure));
+    alloc->verifier = NULL;
+    alloc->waiters = alloc->waiters_tail = NULL;
+    alloc->trace = NULL;
+    alloc->trace_depth = 0;
+    alloc->stats = NULL;
+    memset(alloc->counters, 0, sizeof(alloc->counters));
+    epoch_init(alloc);
+    for (size_t i = 0; i < TAG_COUNT_MAX; i++) {
+        alloc->tags[i].budget = SIZE_MAX;
+        alloc->tags[i].live = alloc->tags[i].peak = alloc->tags[i].rejected = 0;
+    }
+    alloc->controller = alloc->heap = heap;
+    if (controller_new(alloc->controller) != 0
+        || htfh_add_pool(alloc, (char*) alloc->heap + htfh_size(), bytes - htfh_size()) == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+Allocator* htfh_create_flags(size_t bytes, unsigned int flags) {
 #if _DEBUG
     if (test_ffs_fls()) {
 		return 0;
@@ -142,41 +555,230 @@ Allocator* htfh_create(size_t bytes) {
         sprintf(msg, "Memory must be aligned to %u bytes", (unsigned int) ALIGN_SIZE);
         set_alloc_errno_msg(HEAP_MISALIGNED, msg);
         return NULL;
+    } else if (bytes <= htfh_size()) {
+        set_alloc_errno(INVALID_POOL_SIZE);
+        return NULL;
     }
-    Allocator* alloc = malloc(sizeof(*alloc));
+    Allocator* alloc = aligned_alloc(_Alignof(Allocator), sizeof(*alloc));
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
     }
-    int lock_result;
-    if ((lock_result = __htfh_lock_init(&alloc->mutex, PTHREAD_MUTEX_RECURSIVE)) != 0) {
-        set_alloc_errno_msg(MUTEX_LOCK_INIT, strerror(lock_result));
+    alloc->in_place = 0;
+    void* heap = heap_map(alloc, bytes, flags);
+    if (heap == MAP_FAILED) {
+        if (alloc_errno != HEAP_MEMFD_FAILED) {
+            set_alloc_errno(HEAP_MMAP_FAILED);
+        }
+        free(alloc);
         return NULL;
-    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+    } else if (((flags & HTFH_CREATE_REALTIME) && memory_pin(heap, bytes) != 0)
+        || allocator_init(alloc, heap, bytes, flags) != 0) {
+        munmap(heap, bytes);
+        if (alloc->heap_fd != -1) {
+            close(alloc->heap_fd);
+        }
+        free(alloc);
         return NULL;
     }
-    alloc->heap_size = bytes;
-    alloc->controller = alloc->heap = mmap(
-        NULL,
-        bytes,
-        PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANONYMOUS,
-        -1,
-        0
-    );
-    if (alloc->heap == NULL) {
-        set_alloc_errno(HEAP_MMAP_FAILED);
-        __htfh_lock_unlock_handled(&alloc->mutex);
+    return alloc;
+}
+
+Allocator* htfh_create_in_place(void* mem, size_t bytes) {
+    if (mem == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
-    } else if (controller_new(alloc->controller) != 0) {
-        __htfh_lock_unlock_handled(&alloc->mutex);
+    }
+    /* The allocator leads the buffer, the controller and pool follow it. */
+    const uintptr_t start = align_up((uintptr_t) mem, _Alignof(Allocator));
+    const uintptr_t heap = align_up(start + sizeof(Allocator), htfh_max((size_t) ALIGN_SIZE, _Alignof(Controller)));
+    const uintptr_t end = align_down((uintptr_t) mem + bytes, ALIGN_SIZE);
+    if ((uintptr_t) mem + bytes < (uintptr_t) mem || end <= heap || end - heap <= htfh_size()) {
+        set_alloc_errno(INVALID_POOL_SIZE);
         return NULL;
     }
-    htfh_add_pool(alloc, (char*)alloc->heap + htfh_size(), bytes - htfh_size());
-    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? alloc : NULL;
+    Allocator* alloc = (Allocator*) start;
+    alloc->in_place = 1;
+    alloc->heap_fd = -1;
+    return allocator_init(alloc, (void*) heap, end - heap, 0) == 0 ? alloc : NULL;
+}
+
+int htfh_destroy(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    if (alloc->snapshot != NULL) {
+        set_alloc_errno(SNAPSHOT_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (alloc->trace != NULL) {
+        set_alloc_errno(TRACE_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (alloc->stats != NULL) {
+        set_alloc_errno(STATS_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (!alloc->in_place && munmap(alloc->heap, alloc->heap_size) != 0 ) {
+        set_alloc_errno(HEAP_UNMAP_FAILED);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (alloc->heap_fd != -1) {
+        close(alloc->heap_fd);
+    }
+    epoch_destroy(alloc);
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (!alloc->in_place) {
+        free(alloc);
+    }
+    return 0;
+}
+
+int htfh_reset_retain(Allocator* alloc, size_t retain) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    /*
+    ** Pages are released before the pool is re-added, since the pool's
+    ** sentinel block lives in the last page of the heap.
+    */
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t retained = retain < alloc->heap_size && !alloc->realtime
+        ? align_up(htfh_max(retain, htfh_size()), page_size)
+        : alloc->heap_size;
+#if defined(MADV_REMOVE)
+    /* A shared memfd heap only gives its pages back when they are removed from the file. */
+    const int advice = alloc->heap_fd != -1 && alloc->snapshot == NULL ? MADV_REMOVE : MADV_DONTNEED;
+#else
+    const int advice = MADV_DONTNEED;
+#endif
+    if (retained < alloc->heap_size
+        && madvise((char*) alloc->heap + retained, alloc->heap_size - retained, advice) != 0) {
+        set_alloc_errno_msg(HEAP_MADVISE_FAILED, strerror(errno));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    const unsigned int fit_policy = alloc->controller->fit_policy;
+    const int deferred_coalescing = alloc->controller->deferred_coalescing;
+    const size_t generation = alloc->controller->generation;
+    if (controller_new(alloc->controller) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    alloc->controller->fit_policy = fit_policy;
+    alloc->controller->deferred_coalescing = deferred_coalescing;
+    alloc->controller->generation = generation;
+    controller_layout_invalidate(alloc->controller);
+    for (size_t i = 0; i < TAG_COUNT_MAX; i++) {
+        __atomic_store_n(&alloc->tags[i].live, 0, __ATOMIC_RELAXED);
+    }
+    epoch_discard(alloc);
+    for (size_t i = 0; i < alloc->pool_count; i++) {
+        const HeapPool* pool = &alloc->pools[i];
+        if (pool_insert_block(alloc, pool->start, pool_usable_bytes(pool->bytes)) != 0) {
+            __htfh_lock_unlock_handled(&alloc->mutex);
+            return -1;
+        }
+        wake_waiter(alloc, pool_usable_bytes(pool->bytes));
+    }
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_reset(Allocator* alloc) {
+    return htfh_reset_retain(alloc, SIZE_MAX);
+}
+
+int htfh_set_mmap_threshold(Allocator* alloc, size_t bytes) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (alloc->realtime && bytes != 0) {
+        set_alloc_errno(HEAP_REALTIME);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    alloc->mmap_threshold = bytes;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+/* Size of a used block of the given size once released and coalesced with its free neighbours. */
+static size_t coalesced_size(BlockHeader* block, size_t size) {
+    if (block_is_prev_free(block)) {
+        size += block_size(block_prev(block)) + block_header_overhead;
+    }
+    const BlockHeader* next = block_next(block);
+    if (block_is_free(next)) {
+        size += block_size(next) + block_header_overhead;
+    }
+    return size;
+}
+
+/* Return a used heap block of the given size to the heap, the caller must hold the lock. */
+static int free_block(Allocator* alloc, BlockHeader* block, size_t size) {
+    /*
+    ** Quick-listed blocks only coalesce once a search misses, so with
+    ** deferred coalescing any free may satisfy the first waiter.
+    */
+    const size_t released = alloc->waiters == NULL
+        ? 0
+        : alloc->controller->deferred_coalescing ? SIZE_MAX : coalesced_size(block, size);
+    const int status = alloc->controller->deferred_coalescing
+        ? controller_quick_push(alloc->controller, block, size)
+        : controller_block_release(alloc->controller, block);
+    if (status == 0 && released) {
+        wake_waiter(alloc, htfh_min(released, block_size_max - 1));
+    }
+    if (status == 0 && alloc->verifier != NULL && --alloc->verify_countdown == 0) {
+        /* A fault is recorded in and reported by the verifier, the free itself succeeded. */
+        alloc->verify_countdown = alloc->verify_every;
+        htfh_verify_step(alloc->verifier);
+    }
+    return status;
 }
 
-int htfh_destroy(Allocator* alloc) {
+/*
+** Trim a used block down to size, waking the first waiter if the tail
+** released could satisfy it. The caller must hold the lock.
+*/
+static int trim_used_block(Allocator* alloc, BlockHeader* block, size_t size) {
+    const size_t cursize = block_size(block);
+    if (controller_block_trim_used(alloc->controller, block, size) != 0) {
+        return -1;
+    } else if (block_size(block) != cursize) {
+        /* The tail has coalesced with any free block after it. */
+        wake_waiter(alloc, block_size(block_next(block)));
+    }
+    return 0;
+}
+
+/*
+** Locate a free block for an adjusted size, on a miss coalescing any
+** quick-listed blocks and searching again. The caller must hold the lock.
+*/
+static BlockHeader* locate_free(Allocator* alloc, size_t adjust) {
+    BlockHeader* block = controller_block_locate_free(alloc->controller, adjust);
+    if (block == NULL && adjust && controller_quick_flush(alloc->controller) > 0) {
+        block = controller_block_locate_free(alloc->controller, adjust);
+    }
+    return block;
+}
+
+int htfh_set_deferred_coalescing(Allocator* alloc, int enabled) {
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return -1;
@@ -185,40 +787,184 @@ int htfh_destroy(Allocator* alloc) {
         return -1;
     } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
         return -1;
-    }
-    if (munmap(alloc->heap, alloc->heap_size) != 0 ) {
-        set_alloc_errno(HEAP_UNMAP_FAILED);
+    } else if (!enabled && controller_quick_flush(alloc->controller) < 0) {
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
     }
-    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+    alloc->controller->deferred_coalescing = enabled != 0;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_set_fit_policy(Allocator* alloc, unsigned int policy) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
         return -1;
     }
-    free(alloc);
-    return 0;
+    alloc->controller->fit_policy = policy & (FIT_BEST_IN_CLASS | FIT_ADDRESS_ORDERED);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
 }
 
-void* htfh_malloc(Allocator* alloc, size_t size) {
+static void* heap_malloc(Allocator* alloc, size_t size, size_t* usable) {
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
     } else if (alloc->controller == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
+    } else if (use_mapping(alloc, size)) {
+        void* ptr = mapped_block_create(size);
+        if (ptr != NULL && usable != NULL) {
+            *usable = block_size(block_from_ptr(ptr));
+        }
+        return ptr;
     } else if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
         return NULL;
     }
     const size_t adjust = adjust_request_size(size, ALIGN_SIZE);
-    BlockHeader* block = controller_block_locate_free(alloc->controller, adjust);
-    if (block == NULL) {
+    BlockHeader* block = NULL;
+    void* ptr = NULL;
+    if (alloc->controller->deferred_coalescing && (block = controller_quick_pop(alloc->controller, adjust)) != NULL) {
+        /* Quick-listed blocks are still marked as used and need no split. */
+        ptr = block_to_ptr(block);
+    } else if ((block = locate_free(alloc, adjust)) == NULL) {
         __htfh_lock_unlock_handled(&alloc->mutex);
         return NULL;
+    } else {
+        ptr = controller_block_prepare_used(alloc->controller, block, adjust);
+    }
+    if (ptr != NULL && usable != NULL) {
+        /* Trimming may leave slack too small to split, report it as usable. */
+        *usable = block_size(block);
     }
-    void* ptr = controller_block_prepare_used(alloc->controller, block, adjust);
     return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? ptr : NULL;
 }
 
-int htfh_free(Allocator* alloc, void* ptr) {
+static void* traced_malloc(Allocator* alloc, size_t size, size_t* usable) {
+    const int traced = trace_begin(alloc);
+    void* ptr = traced < 0 ? NULL : heap_malloc(alloc, size, usable);
+    if (traced > 0) {
+        trace_end(alloc, ptr != NULL ? TRACE_MALLOC : TRACE_NONE, NULL, ptr, size, 0);
+    }
+    return ptr;
+}
+
+void* htfh_malloc_usable(Allocator* alloc, size_t size, size_t* usable) {
+    void* ptr = traced_malloc(alloc, size, usable);
+    if (ptr == NULL && size && pressure_reclaim(alloc, size)) {
+        ptr = traced_malloc(alloc, size, usable);
+    }
+    if (ptr != NULL) {
+        stats_count(alloc, STATS_MALLOC);
+    } else if (size && alloc_errno == HEAP_FULL) {
+        stats_count(alloc, STATS_HEAP_FULL);
+    }
+    pressure_check(alloc);
+    return ptr;
+}
+
+void* htfh_malloc(Allocator* alloc, size_t size) {
+    return htfh_malloc_usable(alloc, size, NULL);
+}
+
+static void waiter_remove(Allocator* alloc, HeapWaiter* waiter) {
+    HeapWaiter** link = &alloc->waiters;
+    HeapWaiter* prev = NULL;
+    while (*link != waiter) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = waiter->next;
+    if (alloc->waiters_tail == waiter) {
+        alloc->waiters_tail = prev;
+    }
+}
+
+void* htfh_malloc_wait(Allocator* alloc, size_t size, long timeout_ms) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    }
+    const size_t adjust = adjust_request_size(size, ALIGN_SIZE);
+    if (!timeout_ms || !adjust || use_mapping(alloc, size)) {
+        return htfh_malloc(alloc, size);
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return NULL;
+    }
+    /* Only bypass the queue if nobody is waiting already. */
+    void* ptr = alloc->waiters == NULL ? htfh_malloc(alloc, size) : NULL;
+    if (ptr != NULL) {
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return NULL;
+        }
+        pressure_check(alloc);
+        return ptr;
+    }
+    HeapWaiter waiter;
+    pthread_condattr_t attr;
+    int result;
+    if ((result = pthread_condattr_init(&attr)) != 0
+        || (result = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) != 0
+        || (result = pthread_cond_init(&waiter.cond, &attr)) != 0) {
+        set_alloc_errno_msg(CONDITION_INIT, strerror(result));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return NULL;
+    }
+    pthread_condattr_destroy(&attr);
+    mapping_search(adjust, &waiter.fl, &waiter.sl);
+    waiter.next = NULL;
+    if (alloc->waiters_tail != NULL) {
+        alloc->waiters_tail->next = &waiter;
+    } else {
+        alloc->waiters = &waiter;
+    }
+    alloc->waiters_tail = &waiter;
+
+    result = 0;
+    for (;;) {
+        /* Only the first waiter allocates, later arrivals queue behind it. */
+        if (alloc->waiters == &waiter && (ptr = htfh_malloc(alloc, size)) != NULL) {
+            break;
+        } else if (result == ETIMEDOUT) {
+            break;
+        }
+        result = timeout_ms < 0
+            ? pthread_cond_wait(&waiter.cond, &alloc->mutex)
+            : pthread_cond_timedwait(&waiter.cond, &alloc->mutex, &deadline);
+    }
+    const int was_first = alloc->waiters == &waiter;
+    waiter_remove(alloc, &waiter);
+    pthread_cond_destroy(&waiter.cond);
+    if (was_first && alloc->waiters != NULL) {
+        /* The next waiter may already fit in what is left. */
+        pthread_cond_signal(&alloc->waiters->cond);
+    }
+    if (ptr == NULL) {
+        set_alloc_errno(ALLOC_TIMED_OUT);
+    }
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return NULL;
+    }
+    pressure_check(alloc);
+    return ptr;
+}
+
+static int heap_free(Allocator* alloc, void* ptr) {
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return -1;
@@ -236,26 +982,123 @@ int htfh_free(Allocator* alloc, void* ptr) {
         set_alloc_errno(BLOCK_IS_NULL);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
-    } else if (block_is_free(block)) {
+    } else if (block_is_mapped(block)) {
+        /*
+        ** Tested under the lock, since freeing the previous block of a heap
+        ** block rewrites the fields the test reads. Direct-mapped blocks
+        ** never touch the heap, so they are unmapped without it.
+        */
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return -1;
+        }
+        return mapped_block_destroy(block);
+    } else if (block_is_free(block) || controller_quick_holds(alloc->controller, block)) {
         set_alloc_errno(BLOCK_ALREADY_FREED);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
+    } else if (free_block(alloc, block, block_size(block)) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
     }
-    block_mark_as_free(block);
-    block = controller_block_merge_prev(alloc->controller, block);
-    if (block == NULL) {
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_free(Allocator* alloc, void* ptr) {
+    const int traced = trace_begin(alloc);
+    const int status = traced < 0 ? -1 : heap_free(alloc, ptr);
+    if (traced > 0) {
+        trace_end(alloc, status == 0 && ptr != NULL ? TRACE_FREE : TRACE_NONE, ptr, NULL, 0, 0);
+    }
+    if (status == 0 && ptr != NULL) {
+        stats_count(alloc, STATS_FREE);
+    }
+    pressure_check(alloc);
+    return status;
+}
+
+static int heap_free_sized(Allocator* alloc, void* ptr, size_t size) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (ptr == NULL) {
+        /* Don't attempt to free a NULL pointer. */
+        return 0;
+    }
+    const size_t adjust = adjust_request_size(size, ALIGN_SIZE);
+    if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
+        return -1;
+    }
+    BlockHeader* block = block_from_ptr(ptr);
+    /*
+    ** The known size bounds the block from below, so a size that does not
+    ** fit the header indicates a mismatched or corrupted free and is
+    ** rejected before any neighbour is touched.
+    */
+    const size_t cursize = block_size(block);
+    if (block_is_mapped(block)) {
+        if (size > cursize) {
+            set_alloc_errno(BLOCK_SIZE_MISMATCH);
+            __htfh_lock_unlock_handled(&alloc->mutex);
+            return -1;
+        } else if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return -1;
+        }
+        return mapped_block_destroy(block);
+    } else if (block_is_free(block) || controller_quick_holds(alloc->controller, block)) {
+        set_alloc_errno(BLOCK_ALREADY_FREED);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
-    } else if ((block = controller_block_merge_next(alloc->controller, block)) == NULL) {
+    } else if ((size && adjust == 0) || adjust > cursize) {
+        set_alloc_errno(BLOCK_SIZE_MISMATCH);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
-    } else if (controller_block_insert(alloc->controller, block) != 0) {
+    } else if (free_block(alloc, block, cursize) != 0) {
         __htfh_lock_unlock_handled(&alloc->mutex);
         return -1;
     }
     return __htfh_lock_unlock_handled(&alloc->mutex);
 }
 
+int htfh_free_sized(Allocator* alloc, void* ptr, size_t size) {
+    const int traced = trace_begin(alloc);
+    const int status = traced < 0 ? -1 : heap_free_sized(alloc, ptr, size);
+    if (traced > 0) {
+        trace_end(alloc, status == 0 && ptr != NULL ? TRACE_FREE : TRACE_NONE, ptr, NULL, 0, 0);
+    }
+    if (status == 0 && ptr != NULL) {
+        stats_count(alloc, STATS_FREE);
+    }
+    pressure_check(alloc);
+    return status;
+}
+
+int htfh_free_batch(Allocator* alloc, void* const* ptrs, size_t count) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (!count) {
+        return 0;
+    } else if (ptrs == NULL) {
+        set_alloc_errno(BLOCK_IS_NULL);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    /* The lock is recursive, each free below re-enters it without contention. */
+    int status = 0;
+    for (size_t i = 0; i < count; i++) {
+        status |= htfh_free(alloc, ptrs[i]);
+    }
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    pressure_check(alloc);
+    return status;
+}
+
 void* htfh_calloc(Allocator* alloc, size_t count, size_t bytes) {
     void* ptr = htfh_malloc(alloc, count * bytes);
     if (ptr != NULL) {
@@ -264,7 +1107,7 @@ void* htfh_calloc(Allocator* alloc, size_t count, size_t bytes) {
     return ptr;
 }
 
-void* htfh_memalign(Allocator* alloc, size_t align, size_t size) {
+static void* heap_memalign(Allocator* alloc, size_t align, size_t size) {
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
@@ -293,7 +1136,7 @@ void* htfh_memalign(Allocator* alloc, size_t align, size_t size) {
     */
     const size_t aligned_size = (adjust && align > ALIGN_SIZE) ? size_with_gap : adjust;
 
-    BlockHeader* block = controller_block_locate_free(alloc->controller, aligned_size);
+    BlockHeader* block = locate_free(alloc, aligned_size);
     if (sizeof(BlockHeader) != block_size_min + block_header_overhead) {
         set_alloc_errno(BLOCK_SIZE_MISMATCH);
         __htfh_lock_unlock_handled(&alloc->mutex);
@@ -324,7 +1167,30 @@ void* htfh_memalign(Allocator* alloc, size_t align, size_t size) {
     }
 
     void* ptr = controller_block_prepare_used(alloc->controller, block, adjust);
-    return ptr != NULL && __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? ptr : NULL;
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? ptr : NULL;
+}
+
+static void* traced_memalign(Allocator* alloc, size_t align, size_t size) {
+    const int traced = trace_begin(alloc);
+    void* ptr = traced < 0 ? NULL : heap_memalign(alloc, align, size);
+    if (traced > 0) {
+        trace_end(alloc, ptr != NULL ? TRACE_MEMALIGN : TRACE_NONE, NULL, ptr, size, align);
+    }
+    return ptr;
+}
+
+void* htfh_memalign(Allocator* alloc, size_t align, size_t size) {
+    void* ptr = traced_memalign(alloc, align, size);
+    if (ptr == NULL && size && pressure_reclaim(alloc, size + align)) {
+        ptr = traced_memalign(alloc, align, size);
+    }
+    if (ptr != NULL) {
+        stats_count(alloc, STATS_MALLOC);
+    } else if (size && alloc_errno == HEAP_FULL) {
+        stats_count(alloc, STATS_HEAP_FULL);
+    }
+    pressure_check(alloc);
+    return ptr;
 }
 
 /*
@@ -339,66 +1205,202 @@ void* htfh_memalign(Allocator* alloc, size_t align, size_t size) {
 **   untouched
 ** - an extended buffer size will leave the newly-allocated area with
 **   contents undefined
+**
+** Growth is attempted in place before falling back to malloc + copy:
+** first into a free next block, then additionally into a free previous
+** block, in which case the payload is shifted down with memmove.
 */
-void* htfh_realloc(Allocator* alloc, void* ptr, size_t size) {
+static void* heap_realloc(Allocator* alloc, void* ptr, size_t size) {
     if (alloc == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
     } else if (alloc->controller == NULL) {
         set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
         return NULL;
-    } else if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
-        return NULL;
-    }
-    void* p = NULL;
-    /* Zero-size requests are treated as free. */
-    if (ptr && size == 0) {
+    } else if (ptr && size == 0) {
+        /* Zero-size requests are treated as free. */
         htfh_free(alloc, ptr);
+        return NULL;
     } else if (!ptr) {
         /* Requests with NULL pointers are treated as malloc. */
-        p = htfh_malloc(alloc, size);
-        return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? p : NULL;
+        return htfh_malloc(alloc, size);
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
+        return NULL;
     }
+    void* p = NULL;
     BlockHeader* block = block_from_ptr(ptr);
-    BlockHeader* next = block_next(block);
-
-    const size_t cursize = block_size(block);
-    const size_t combined = cursize + block_size(next) + block_header_overhead;
-    const size_t adjust = adjust_request_size(size, ALIGN_SIZE);
-
-    if (block_is_free(block)) {
+    if (block_is_mapped(block)) {
+        /*
+        ** A direct mapping belongs to the caller alone, so only the decision
+        ** is taken under the lock; the remap, copy and unmap run without it.
+        ** Stay mapped while above the threshold, otherwise move back into
+        ** the heap.
+        */
+        const int stay_mapped = use_mapping(alloc, size);
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return NULL;
+        } else if (!stay_mapped && (p = htfh_malloc(alloc, size)) != NULL) {
+            memcpy(p, ptr, htfh_min(block_size(block), size));
+            mapped_block_destroy(block);
+        } else if ((block = mapped_block_resize(block, size, 1)) != NULL) {
+            p = block_to_ptr(block);
+        }
+        return p;
+    } else if (block_is_free(block) || controller_quick_holds(alloc->controller, block)) {
         set_alloc_errno(BLOCK_ALREADY_FREED);
         __htfh_lock_unlock_handled(&alloc->mutex);
         return NULL;
     }
+    BlockHeader* next = block_next(block);
+    if (next == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return NULL;
+    }
 
-    /*
-    ** If the next block is used, or when combined with the current
-    ** block, does not offer enough space, we must reallocate and copy.
-    */
-    if (adjust > cursize && (!block_is_free(next) || adjust > combined)) {
-        if ((p = htfh_malloc(alloc, size)) != NULL) {
+    const size_t cursize = block_size(block);
+    const size_t adjust = adjust_request_size(size, ALIGN_SIZE);
+    const size_t next_size = block_is_free(next) ? block_size(next) + block_header_overhead : 0;
+    const size_t prev_size = block_is_prev_free(block) ? block_size(block_prev(block)) + block_header_overhead : 0;
+
+    if (!adjust || adjust > cursize + next_size + prev_size || use_mapping(alloc, size)) {
+        /*
+        ** Neither neighbour offers enough space, or the block is now large
+        ** enough to be mapped directly, we must reallocate and copy. The
+        ** block stays in use until it is freed, so the copy is made outside
+        ** the lock.
+        */
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return NULL;
+        } else if ((p = htfh_malloc(alloc, size)) != NULL) {
             memcpy(p, ptr, htfh_min(cursize, size));
             htfh_free(alloc, ptr);
         }
-        return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? p : NULL;
+        return p;
+    } else if (adjust > cursize + next_size) {
+        /* Expand backwards into the previous block and shift the payload down. */
+        if ((block = controller_block_shift_into_prev(alloc->controller, block)) == NULL
+            || (block = controller_block_merge_next(alloc->controller, block)) == NULL) {
+            __htfh_lock_unlock_handled(&alloc->mutex);
+            return NULL;
+        }
+        block_mark_as_used(block);
+        ptr = block_to_ptr(block);
     } else if (adjust > cursize) {
-        /* Do we need to expand to the next block? */
-        if (controller_block_merge_next(alloc->controller, block) != 0) {
+        /* Expand forwards into the next block. */
+        if (controller_block_merge_next(alloc->controller, block) == NULL) {
             __htfh_lock_unlock_handled(&alloc->mutex);
             return NULL;
         }
         block_mark_as_used(block);
     }
 
-    /* Trim the resulting block and return the original pointer. */
-    if (controller_block_trim_used(alloc->controller, block, adjust) != 0) {
+    /* Trim the resulting block and return the (possibly shifted) pointer. */
+    if (trim_used_block(alloc, block, adjust) != 0) {
         __htfh_lock_unlock_handled(&alloc->mutex);
         return NULL;
     }
     return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? ptr : NULL;
 }
 
+void* htfh_realloc(Allocator* alloc, void* ptr, size_t size) {
+    const int traced = trace_begin(alloc);
+    void* p = traced < 0 ? NULL : heap_realloc(alloc, ptr, size);
+    /* A realloc to size 0 frees the block and returns NULL. */
+    const int done = p != NULL || (ptr != NULL && size == 0);
+    if (traced > 0) {
+        trace_end(alloc, done ? TRACE_REALLOC : TRACE_NONE, ptr, p, size, 0);
+    }
+    if (done) {
+        /* Refusals are counted by the malloc a moving realloc falls back to. */
+        stats_count(alloc, STATS_REALLOC);
+    }
+    pressure_check(alloc);
+    return p;
+}
+
+size_t htfh_try_expand(Allocator* alloc, void* ptr, size_t min, size_t max) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return 0;
+    } else if (alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return 0;
+    } else if (ptr == NULL) {
+        set_alloc_errno(FREE_NULL_PTR);
+        return 0;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) == -1) {
+        return 0;
+    }
+    BlockHeader* block = block_from_ptr(ptr);
+    if (block_is_mapped(block)) {
+        /*
+        ** Grow the mapping without moving it, falling back to the minimum.
+        ** Only the caller owns the mapping, so it is resized without the lock.
+        */
+        const size_t reach = mapped_size_max();
+        if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+            return 0;
+        } else if (min > reach) {
+            set_alloc_errno(CANNOT_EXPAND_BLOCK);
+            return 0;
+        }
+        BlockHeader* resized = block;
+        const size_t target = htfh_min(htfh_max(min, max), reach);
+        if (target > block_size(block)) {
+            resized = mapped_block_resize(block, target, 0);
+            if (resized == NULL && min > block_size(block)) {
+                resized = mapped_block_resize(block, min, 0);
+            } else if (resized == NULL) {
+                resized = block;
+            }
+        }
+        if (resized == NULL) {
+            set_alloc_errno(CANNOT_EXPAND_BLOCK);
+            return 0;
+        }
+        return block_size(resized);
+    } else if (block_is_free(block) || controller_quick_holds(alloc->controller, block)) {
+        set_alloc_errno(BLOCK_ALREADY_FREED);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return 0;
+    }
+    BlockHeader* next = block_next(block);
+    if (next == NULL) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return 0;
+    }
+    const size_t cursize = block_size(block);
+    const size_t next_size = block_is_free(next) ? block_size(next) + block_header_overhead : 0;
+    /* Requests are clamped to what the block can reach, adjusting a size past block_size_max yields 0. */
+    const size_t reach = htfh_min(cursize + next_size, block_size_max - ALIGN_SIZE);
+    const size_t adjust_min = adjust_request_size(min, ALIGN_SIZE);
+    const size_t adjust_max = adjust_request_size(htfh_min(htfh_max(min, max), reach), ALIGN_SIZE);
+
+    if (min > reach || adjust_min > cursize + next_size) {
+        /* The block cannot reach the minimum without moving, leave it untouched. */
+        set_alloc_errno(CANNOT_EXPAND_BLOCK);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return 0;
+    } else if (adjust_max > cursize && next_size) {
+        if (controller_block_merge_next(alloc->controller, block) == NULL) {
+            __htfh_lock_unlock_handled(&alloc->mutex);
+            return 0;
+        }
+        block_mark_as_used(block);
+        /* Hand back anything beyond the maximum requested size. */
+        if (trim_used_block(alloc, block, adjust_max) != 0) {
+            __htfh_lock_unlock_handled(&alloc->mutex);
+            return 0;
+        }
+    }
+    const size_t usable = block_size(block);
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return 0;
+    }
+    pressure_check(alloc);
+    return usable;
+}
+
 // ==== DEBUG ====
 
 #define htfh_insist(x) { htfh_assert(x); if (!(x)) { status--; } }
@@ -456,7 +1458,7 @@ int htfh_check(Allocator* htfh) {
 
                 mapping_insert(block_size(block), &fli, &sli);
                 htfh_insist(fli == i && sli == j && "block size indexed in wrong list");
-                block = block->next_free;
+                block = block_next_free(block);
             }
         }
     }
@@ -486,6 +1488,50 @@ void htfh_walk_pool(void* pool, htfh_walker walker, void* user) {
     }
 }
 
+int htfh_walk_pools(Allocator* alloc, htfh_walker walker, void* user) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < alloc->pool_count; i++) {
+        htfh_walk_pool(alloc->pools[i].start, walker, user);
+    }
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+static void stats_walker(void* ptr, size_t size, int used, void* user) {
+    (void) ptr;
+    PoolStats* stats = (PoolStats*) user;
+    if (used) {
+        stats->used_blocks++;
+        stats->used_bytes += size;
+    } else {
+        stats->free_blocks++;
+        stats->free_bytes += size;
+        stats->largest_free = htfh_max(stats->largest_free, size);
+    }
+}
+
+int htfh_pool_stats(Allocator* alloc, void* pool, PoolStats* stats) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    const ptrdiff_t index = pool_search(alloc, pool);
+    if (index < 0 || alloc->pools[index].start != pool) {
+        set_alloc_errno(POOL_NOT_FOUND);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    *stats = (PoolStats) { 0 };
+    htfh_walk_pool(pool, stats_walker, stats);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
 size_t htfh_block_size(void* ptr) {
     if (ptr == NULL) {
         return 0;
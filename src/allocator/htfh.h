@@ -12,13 +12,166 @@ extern "C" {
 #include "../thread/lock.h"
 #include "controller.h"
 
-/* Allocator: a TLSF structure. Can contain 1 to N pools. */
+#ifndef HTFH_MMAP_THRESHOLD
+/*
+** Requests of at least this many bytes are served from their own anonymous
+** mapping instead of the heap. A value of 0 disables direct mapping.
+*/
+#define HTFH_MMAP_THRESHOLD 0
+#endif
+
+/* Creation flags for htfh_create_flags. */
+enum htfh_create_flag {
+    /* Back the heap with a memfd instead of anonymous memory, required for snapshots. */
+    HTFH_CREATE_MEMFD = 1 << 0,
+    /*
+    ** Prefault and lock the heap into memory and guard it with a priority
+    ** inheriting mutex. Direct mapping and page release are disabled, so
+    ** allocation and free never enter the kernel unless the mutex is
+    ** contended.
+    */
+    HTFH_CREATE_REALTIME = 1 << 1,
+};
+
+struct HeapSnapshot;
+struct HeapVerifier;
+struct HeapWaiter;
+struct HeapTrace;
+struct HeapStats;
+
+#ifdef STATIC_CFH
+#ifndef STATIC_CFH_HEAP_SIZE
+#error "STATIC_CFH requires STATIC_CFH_HEAP_SIZE to be defined"
+#endif
+#ifndef STATIC_CFH_CONSTRUCTOR_PRIORITY
+#define STATIC_CFH_CONSTRUCTOR_PRIORITY 101
+#endif
+#ifndef STATIC_CFH_DESTRUCTOR_PRIORITY
+#define STATIC_CFH_DESTRUCTOR_PRIORITY 101
+#endif
+#endif
+
+/* Memory range registered as a pool, start is the address given to htfh_add_pool. */
+typedef struct HeapPool {
+    char* start;
+    size_t bytes;
+} HeapPool;
+
+/* Block statistics of a single pool, gathered by walking it. */
+typedef struct PoolStats {
+    size_t used_blocks;
+    size_t used_bytes;
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest_free;
+} PoolStats;
+
+/* Byte budget and accounting of an allocation tag, see tag.h. */
+typedef struct HeapTag {
+    /* Usable bytes the tag may hold, SIZE_MAX if unlimited. */
+    size_t budget;
+    /* Usable bytes currently held and the most ever held, updated atomically. */
+    size_t live;
+    size_t peak;
+    /* Requests refused for exceeding the budget. */
+    size_t rejected;
+} HeapTag;
+
+struct Allocator;
+
+/* Pressure levels defined by the watermarks, see pressure.h. */
+enum htfh_pressure_level {
+    PRESSURE_NONE,
+    PRESSURE_LOW,
+    PRESSURE_HIGH,
+};
+
+typedef void (*htfh_pressure_callback)(struct Allocator* alloc, int level, size_t used, void* user);
+typedef size_t (*htfh_reclaim_callback)(struct Allocator* alloc, size_t bytes, void* user);
+
+/* Used byte watermarks and reclaim hooks of an allocator, see pressure.h. */
+typedef struct HeapPressure {
+    size_t low;
+    size_t high;
+    /* Run when the level changes, NULL if watermarks are disabled. */
+    htfh_pressure_callback callback;
+    void* user;
+    /* Level last reported, updated atomically. */
+    int level;
+    /* Run once before a failing allocation is retried, NULL if none. */
+    htfh_reclaim_callback reclaim;
+    void* reclaim_user;
+} HeapPressure;
+
+/* Operations counted while statistics are published, see stats.h. */
+enum htfh_stats_counter {
+    STATS_MALLOC,
+    STATS_FREE,
+    STATS_REALLOC,
+    /* Allocations refused with HEAP_FULL. */
+    STATS_HEAP_FULL,
+    STATS_COUNTER_COUNT,
+};
+
+struct EpochThread;
+
+/* Epoch-based reclamation state of an allocator, see epoch.h. */
+typedef struct HeapEpoch {
+    /* Global epoch, only ever advanced by one. */
+    uint64_t epoch;
+    /* Registered threads, pushed under the allocator lock and kept until destroy. */
+    struct EpochThread* threads;
+    /* Distinguishes this allocator from any earlier one at the same address. */
+    uint64_t session;
+    /* Resets of the heap, owners drop blocks retired before the latest. */
+    uint64_t discards;
+    /* Holds each thread's registration and releases it when the thread exits, created on first use. */
+    pthread_key_t key;
+    int key_created;
+} HeapEpoch;
+
+/* Allocator: a TLSF structure. Can contain 1 to POOL_COUNT_MAX pools. */
 /* pool_t: a block of memory that TLSF can manage. */
 typedef struct Allocator {
-    __htfh_lock_t mutex;
+    /* Read by every malloc and free, kept together on the first cache lines. */
     Controller* controller;
-    size_t heap_size;
+    /* Minimum request size served by a direct mapping, 0 if disabled. */
+    size_t mmap_threshold;
+    /* Active trace recorder, NULL if none, see trace.h. */
+    struct HeapTrace* trace;
+    unsigned int trace_depth;
+    /* Verifier stepped from every verify_every-th free, NULL if none is attached. */
+    struct HeapVerifier* verifier;
+    unsigned int verify_every;
+    unsigned int verify_countdown;
+    /* Callers parked in htfh_malloc_wait, served in arrival order. */
+    struct HeapWaiter* waiters;
+    struct HeapWaiter* waiters_tail;
+    /* Published statistics segment, NULL if none, see stats.h. */
+    struct HeapStats* stats;
+    /* Checked on return from every allocation and free. */
+    HeapPressure pressure;
+    /* On a cache line of its own, so contending threads do not disturb the fields above. */
+    _Alignas(CACHE_LINE_SIZE) __htfh_lock_t mutex;
+    /* Counted atomically while statistics are published, apart from the lock and the fields above. */
+    _Alignas(CACHE_LINE_SIZE) uint64_t counters[STATS_COUNTER_COUNT];
+    _Alignas(CACHE_LINE_SIZE) size_t heap_size;
     void* heap;
+    /* memfd backing the heap, -1 for anonymous memory. */
+    int heap_fd;
+    /* Active snapshot, the heap is mapped copy-on-write while it is set. */
+    struct HeapSnapshot* snapshot;
+    /* Allocator and heap live in caller memory, destroy releases neither. */
+    int in_place;
+    /* Created with HTFH_CREATE_REALTIME, pools are locked into memory as they are added. */
+    int realtime;
+    /* Registered pools sorted by start address, the primary heap pool included. */
+    HeapPool pools[POOL_COUNT_MAX];
+    size_t pool_count;
+    /* Usable bytes of the registered pools, updated atomically. */
+    size_t pool_bytes;
+    HeapTag tags[TAG_COUNT_MAX];
+    HeapEpoch epoch;
 } Allocator;
 
 typedef struct integrity_t {
@@ -28,18 +181,103 @@ typedef struct integrity_t {
 
 /* Create/destroy a memory pool. */
 Allocator* htfh_create(size_t bytes);
+/* Create with a combination of htfh_create_flag values. */
+Allocator* htfh_create_flags(size_t bytes, unsigned int flags);
+/*
+** Construct an allocator entirely inside the given buffer, such as static
+** storage, a stack frame or a shared region. The allocator, controller and
+** pool are placed at the start of the buffer and no memory is mapped or
+** malloc'd. htfh_destroy leaves the buffer to the caller.
+*/
+Allocator* htfh_create_in_place(void* mem, size_t bytes);
+#ifdef STATIC_CFH
+/*
+** Allocator over STATIC_CFH_HEAP_SIZE bytes of static storage, constructed
+** in place before main with STATIC_CFH_CONSTRUCTOR_PRIORITY and destroyed
+** after exit with STATIC_CFH_DESTRUCTOR_PRIORITY. NULL if construction
+** failed, alloc_errno then holds the cause.
+*/
+Allocator* htfh_static_allocator(void);
+#endif
 int htfh_destroy(Allocator* alloc);
 
-/* Add/remove memory pools. */
+/*
+** Discard every allocation in O(1) by reinitialising the controller and
+** re-adding the heap as a single free block, keeping the mapping and its
+** resident pages along with the fit and coalescing settings. With
+** htfh_reset_retain, pages beyond the first retain bytes of the heap are
+** additionally given back to the system with madvise, unless the heap
+** is realtime and so stays locked. Direct-mapped blocks are not affected.
+*/
+int htfh_reset(Allocator* alloc);
+int htfh_reset_retain(Allocator* alloc, size_t retain);
+
+/*
+** Set the request size at or above which allocations bypass the heap and
+** are mapped directly, 0 disables. Direct-mapped blocks are released by
+** htfh_free and resized with mremap by htfh_realloc, they are not
+** reclaimed by htfh_destroy. A realtime allocator only accepts 0.
+*/
+int htfh_set_mmap_threshold(Allocator* alloc, size_t bytes);
+
+/*
+** Select the free block policy as a combination of FitPolicy flags, the
+** default is FIT_GOOD. Address ordering applies to blocks freed after
+** the change.
+*/
+int htfh_set_fit_policy(Allocator* alloc, unsigned int policy);
+
+/*
+** Enable or disable deferred coalescing. While enabled, freed blocks of up
+** to QUICK_LIST_SIZE_MAX bytes stay unmerged on exact-size quick-lists and
+** are reused directly by allocations of the same size. They are coalesced
+** when a list exceeds QUICK_LIST_DEPTH, when a search misses, or when the
+** mode is disabled. Quick-listed blocks are reported as used by the walker.
+*/
+int htfh_set_deferred_coalescing(Allocator* alloc, int enabled);
+
+/*
+** Add/remove memory pools. Pools other than the primary heap remain owned
+** by the caller, htfh_destroy does not release them. A pool can only be
+** removed while none of its blocks are allocated, after which its memory
+** may be reused or given back. htfh_reset re-adds every registered pool.
+*/
 void* htfh_add_pool(Allocator* alloc, void* mem, size_t bytes);
+int htfh_remove_pool(Allocator* alloc, void* pool);
+/* Primary heap pool, as passed to htfh_add_pool at creation. */
+void* htfh_get_pool(Allocator* alloc);
+
+/*
+** Returns nonzero if ptr lies within a pool registered with the allocator,
+** found by binary search over the sorted pool ranges. Direct-mapped blocks
+** are not covered.
+*/
+int htfh_owns(Allocator* alloc, const void* ptr);
+int htfh_pool_stats(Allocator* alloc, void* pool, PoolStats* stats);
 
 /* malloc/memalign/realloc/free replacements. */
 int htfh_free(Allocator* alloc, void* ptr);
+/*
+** Free with the size originally requested, rejecting sizes that do not
+** fit the block. Costs the same as htfh_free apart from the check.
+*/
+int htfh_free_sized(Allocator* alloc, void* ptr, size_t size);
+/*
+** Free count pointers under a single acquisition of the allocator lock.
+** Every pointer is attempted, -1 is returned if any of them failed.
+*/
+int htfh_free_batch(Allocator* alloc, void* const* ptrs, size_t count);
 __attribute__((malloc
 #if __GNUC__ >= 10
 , malloc (htfh_free, 2)
 #endif
 )) __attribute__((alloc_size(2))) void* htfh_malloc(Allocator* alloc, size_t bytes);
+/* As htfh_malloc, additionally storing the real capacity of the block in usable. */
+__attribute__((malloc
+#if __GNUC__ >= 10
+, malloc (htfh_free, 2)
+#endif
+)) __attribute__((alloc_size(2))) void* htfh_malloc_usable(Allocator* alloc, size_t bytes, size_t* usable);
 __attribute__((malloc
 #if __GNUC__ >= 10
 , malloc (htfh_free, 2)
@@ -56,6 +294,27 @@ __attribute__((malloc
 #endif
 )) __attribute__((alloc_size(3))) void* htfh_realloc(Allocator* alloc, void* ptr, size_t size);
 
+/*
+** As htfh_malloc, but while the heap cannot satisfy the request the caller
+** is parked until a free produces a block large enough or timeout_ms
+** expires, failing with ALLOC_TIMED_OUT. A negative timeout waits without
+** limit and 0 does not wait. Waiters are served in arrival order, so a
+** large request is not starved by smaller ones arriving after it. Must not
+** be called while holding the allocator mutex.
+*/
+__attribute__((malloc
+#if __GNUC__ >= 10
+, malloc (htfh_free, 2)
+#endif
+)) __attribute__((alloc_size(2))) void* htfh_malloc_wait(Allocator* alloc, size_t bytes, long timeout_ms);
+
+/*
+** Grow a used block in place into a free next block without moving it.
+** Succeeds only if at least min bytes are reachable, expands to at most
+** max bytes and returns the new usable size, or 0 on failure.
+*/
+size_t htfh_try_expand(Allocator* alloc, void* ptr, size_t min, size_t max);
+
 /* Returns internal block size, not original request size */
 size_t htfh_block_size(void* ptr);
 
@@ -70,6 +329,8 @@ size_t htfh_alloc_overhead(void);
 /* Debugging. */
 typedef void (*htfh_walker)(void* ptr, size_t size, int used, void* user);
 void htfh_walk_pool(void* pool, htfh_walker walker, void* user);
+/* Walk every registered pool in address order under the allocator mutex. */
+int htfh_walk_pools(Allocator* alloc, htfh_walker walker, void* user);
 /* Returns nonzero if any internal consistency check fails. */
 int htfh_check(Allocator* htfh);
 int htfh_check_pool(void* pool);
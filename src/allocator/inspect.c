@@ -0,0 +1,74 @@
+#include "inspect.h"
+
+/* Lowest registered pool starting at or above addr, NULL if none. */
+static char* inspect_pool_from(const Allocator* alloc, const char* addr) {
+    for (size_t i = 0; i < alloc->pool_count; i++) {
+        if (alloc->pools[i].start >= addr) {
+            return alloc->pools[i].start;
+        }
+    }
+    return NULL;
+}
+
+int htfh_inspect_begin(Allocator* alloc, HeapCursor* cursor) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    cursor->alloc = alloc;
+    cursor->pool = inspect_pool_from(alloc, NULL);
+    cursor->block = NULL;
+    cursor->generation = alloc->controller->generation;
+    cursor->reported = NULL;
+    cursor->restarts = 0;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_inspect_step(HeapCursor* cursor, size_t max_blocks, htfh_walker walker, void* user) {
+    if (cursor == NULL || cursor->alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (walker == NULL) {
+        set_alloc_errno(NULL_WALKER);
+        return -1;
+    }
+    Allocator* alloc = cursor->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (cursor->pool == NULL) {
+        return __htfh_lock_unlock_handled(&alloc->mutex);
+    }
+    const Controller* control = alloc->controller;
+    if (inspect_pool_from(alloc, cursor->pool) != cursor->pool) {
+        /* The pool was removed, continue with the next one up. */
+        cursor->pool = inspect_pool_from(alloc, cursor->pool);
+        cursor->block = NULL;
+        cursor->reported = NULL;
+    } else if (cursor->block != NULL && !controller_layout_valid(control, cursor->generation, cursor->block)) {
+        cursor->block = NULL;
+        cursor->restarts++;
+    }
+    while (max_blocks > 0 && cursor->pool != NULL) {
+        if (cursor->block == NULL) {
+            cursor->block = offset_to_block(cursor->pool, -(ptrdiff_t) block_header_overhead);
+        }
+        BlockHeader* block = cursor->block;
+        if (block_is_last(block)) {
+            cursor->pool = inspect_pool_from(alloc, cursor->pool + 1);
+            cursor->block = NULL;
+            cursor->reported = NULL;
+            continue;
+        }
+        if (cursor->reported == NULL || block > cursor->reported) {
+            walker(block_to_ptr(block), block_size(block), !block_is_free(block), user);
+            cursor->reported = block;
+        }
+        cursor->block = block_next(block);
+        max_blocks--;
+    }
+    cursor->generation = control->generation;
+    const int remaining = cursor->pool != NULL;
+    return __htfh_lock_unlock_handled(&alloc->mutex) == 0 ? remaining : -1;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_INSPECT_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_INSPECT_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "htfh.h"
+
+/*
+** Incremental heap inspection on a live, multi-threaded heap.
+**
+** Each step walks a bounded number of blocks under the allocator mutex
+** and releases it again, so other threads are stalled for at most one
+** step. Between steps the cursor keeps its position together with the
+** controller's layout generation. If the layout changed, the position is
+** checked against the log of recently merged headers. When it may have
+** been merged away, the walk restarts from the start of the pool and
+** skips, without reporting, every block at or below the last one that was
+** reported.
+**
+** Blocks are reported in increasing address order and each at most once,
+** with their state as of the step that visits them. Blocks split or
+** merged behind the cursor are not revisited.
+*/
+typedef struct HeapCursor {
+    Allocator* alloc;
+    /* Pool being walked, NULL once every pool has been walked. */
+    char* pool;
+    /* Next block to visit, NULL to start from the beginning of pool. */
+    BlockHeader* block;
+    /* Layout generation at which block was known to be valid. */
+    size_t generation;
+    /* Last block reported in pool, blocks up to it are skipped on a restart. */
+    const BlockHeader* reported;
+    /* Number of times the walk had to restart from the start of a pool. */
+    size_t restarts;
+} HeapCursor;
+
+/* Position a cursor before the first block of the lowest registered pool. */
+int htfh_inspect_begin(Allocator* alloc, HeapCursor* cursor);
+/*
+** Visit up to max_blocks blocks and report them to walker, blocks skipped
+** after a restart count towards the budget. Returns 1 while blocks remain,
+** 0 once every pool has been walked and -1 on error.
+*/
+int htfh_inspect_step(HeapCursor* cursor, size_t max_blocks, htfh_walker walker, void* user);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_INSPECT_
@@ -0,0 +1,115 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "iobuf.h"
+#include <limits.h>
+#include <unistd.h>
+
+int htfh_iobuf_alloc(Allocator* alloc, size_t bytes, IoSlice* slice) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (slice == NULL) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return -1;
+    } else if (!bytes) {
+        set_alloc_errno(NON_ZERO_BLOCK_SIZE);
+        return -1;
+    }
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t capacity = align_up(bytes, page_size);
+    if (capacity < bytes || capacity + sizeof(IoBuf) < capacity) {
+        set_alloc_errno(HEAP_FULL);
+        return -1;
+    }
+    /* The header follows the data, keeping the data on a page boundary without a page of padding. */
+    char* data = htfh_memalign(alloc, page_size, capacity + sizeof(IoBuf));
+    if (data == NULL) {
+        return -1;
+    }
+    IoBuf* buf = (IoBuf*) (data + capacity);
+    buf->alloc = alloc;
+    buf->data = data;
+    buf->capacity = capacity;
+    buf->refs = 1;
+    slice->buf = buf;
+    slice->data = data;
+    slice->length = capacity;
+    return 0;
+}
+
+/* Check a sub-range against a slice, so that slices never reach outside their buffer. */
+static int ioslice_range_valid(const IoSlice* slice, size_t offset, size_t length) {
+    if (slice == NULL || slice->buf == NULL) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return 0;
+    } else if (offset > slice->length || length > slice->length - offset) {
+        set_alloc_errno(IOSLICE_OUT_OF_RANGE);
+        return 0;
+    }
+    return 1;
+}
+
+int htfh_ioslice_sub(const IoSlice* slice, size_t offset, size_t length, IoSlice* sub) {
+    if (sub == NULL) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return -1;
+    } else if (!ioslice_range_valid(slice, offset, length)) {
+        return -1;
+    }
+    /* The caller's reference keeps the buffer alive, so a relaxed increment suffices. */
+    __atomic_add_fetch(&slice->buf->refs, 1, __ATOMIC_RELAXED);
+    sub->buf = slice->buf;
+    sub->data = slice->data + offset;
+    sub->length = length;
+    return 0;
+}
+
+int htfh_ioslice_narrow(IoSlice* slice, size_t offset, size_t length) {
+    if (!ioslice_range_valid(slice, offset, length)) {
+        return -1;
+    }
+    slice->data += offset;
+    slice->length = length;
+    return 0;
+}
+
+int htfh_ioslice_release(IoSlice* slice) {
+    if (slice == NULL || slice->buf == NULL) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return -1;
+    }
+    IoBuf* buf = slice->buf;
+    slice->buf = NULL;
+    slice->data = NULL;
+    slice->length = 0;
+    /* Writes through other slices must be visible before the block is reused. */
+    if (__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return 0;
+    }
+    return htfh_free(buf->alloc, buf->data);
+}
+
+size_t htfh_ioslice_refs(const IoSlice* slice) {
+    if (slice == NULL || slice->buf == NULL) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return 0;
+    }
+    return __atomic_load_n(&slice->buf->refs, __ATOMIC_RELAXED);
+}
+
+int htfh_ioslice_iovec(const IoSlice* slices, int count, struct iovec* iov) {
+    if (count < 0 || count > IOV_MAX) {
+        set_alloc_errno(INVALID_IOVEC_COUNT);
+        return -1;
+    } else if (count > 0 && (slices == NULL || iov == NULL)) {
+        set_alloc_errno(NULL_IOSLICE_INSTANCE);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = slices[i].data;
+        iov[i].iov_len = slices[i].length;
+    }
+    return count;
+}
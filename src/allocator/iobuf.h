@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_IOBUF_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_IOBUF_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include "htfh.h"
+
+/*
+** Zero-copy I/O buffers.
+**
+** A buffer is a single block taken from the heap with htfh_memalign,
+** starting on a page boundary and holding a whole number of pages, so it
+** can be the target of O_DIRECT reads and writes. Its reference count
+** lives in a small header placed after the data in the same block.
+**
+** Buffers are only reached through slices: a slice is a plain value
+** naming a byte range of a buffer and holding one reference to it.
+** Taking a sub-range produces a new slice sharing the buffer without
+** copying or allocating, narrowing changes a slice in place. Releasing
+** the last slice of a buffer returns its block to the heap with
+** htfh_free. Reference counts are updated atomically, so slices of one
+** buffer may be held and released by different threads, a single slice
+** value must not be used by two threads at once.
+*/
+typedef struct IoBuf {
+    Allocator* alloc;
+    /* Page aligned data, also the start of the block. */
+    char* data;
+    /* Bytes of data, a multiple of the page size. */
+    size_t capacity;
+    /* Slices referring to the buffer, updated atomically. */
+    size_t refs;
+} IoBuf;
+
+typedef struct IoSlice {
+    IoBuf* buf;
+    char* data;
+    size_t length;
+} IoSlice;
+
+/*
+** Allocate a buffer of at least bytes, rounded up to whole pages, and
+** return a slice over all of it.
+*/
+int htfh_iobuf_alloc(Allocator* alloc, size_t bytes, IoSlice* slice);
+/* Take a new slice of length bytes at offset into slice, sharing its buffer. */
+int htfh_ioslice_sub(const IoSlice* slice, size_t offset, size_t length, IoSlice* sub);
+/* Shrink a slice in place to length bytes at offset into it, the reference is kept. */
+int htfh_ioslice_narrow(IoSlice* slice, size_t offset, size_t length);
+/* Drop the slice's reference, freeing the buffer with its last slice, and clear it. */
+int htfh_ioslice_release(IoSlice* slice);
+/* Slices currently sharing the slice's buffer, this one included. */
+size_t htfh_ioslice_refs(const IoSlice* slice);
+/*
+** Describe count slices as an iovec array for readv, writev and their
+** relatives. Returns count, or -1 if count exceeds IOV_MAX.
+*/
+int htfh_ioslice_iovec(const IoSlice* slices, int count, struct iovec* iov);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_IOBUF_
@@ -0,0 +1,316 @@
+#include "objpool.h"
+
+#define HEAD_SHIFT (sizeof(objpool_head_t) * CHAR_BIT / 2)
+
+static inline ObjPoolSlot* head_slot(objpool_head_t head) {
+    return (ObjPoolSlot*) (uintptr_t) head;
+}
+
+#if defined(OBJPOOL_LOCK_FREE)
+
+static inline objpool_head_t head_make(ObjPoolSlot* slot, objpool_head_t tag) {
+    return (objpool_head_t) (uintptr_t) slot | (tag << HEAD_SHIFT);
+}
+
+static inline objpool_head_t head_tag(objpool_head_t head) {
+    return head >> HEAD_SHIFT;
+}
+
+/* Push a linked chain of slots onto the free stack. */
+static void objpool_push_chain(ObjPool* pool, ObjPoolSlot* first, ObjPoolSlot* last) {
+    objpool_head_t head = pool->free_list;
+    for (;;) {
+        last->next = head_slot(head);
+        const objpool_head_t seen = __sync_val_compare_and_swap(
+            &pool->free_list,
+            head,
+            head_make(first, head_tag(head) + 1)
+        );
+        if (seen == head) {
+            return;
+        }
+        head = seen;
+    }
+}
+
+static ObjPoolSlot* objpool_pop(ObjPool* pool) {
+    objpool_head_t head = pool->free_list;
+    for (;;) {
+        ObjPoolSlot* slot = head_slot(head);
+        if (slot == NULL) {
+            return NULL;
+        }
+        /*
+        ** slot->next may be stale if another thread popped the slot first,
+        ** the tag then no longer matches and the exchange is retried.
+        */
+        const objpool_head_t seen = __sync_val_compare_and_swap(
+            &pool->free_list,
+            head,
+            head_make(slot->next, head_tag(head) + 1)
+        );
+        if (seen == head) {
+            return slot;
+        }
+        head = seen;
+    }
+}
+
+/* Detach the whole free stack. */
+static ObjPoolSlot* objpool_take_all(ObjPool* pool) {
+    objpool_head_t head = pool->free_list;
+    for (;;) {
+        const objpool_head_t seen = __sync_val_compare_and_swap(
+            &pool->free_list,
+            head,
+            head_make(NULL, head_tag(head) + 1)
+        );
+        if (seen == head) {
+            return head_slot(head);
+        }
+        head = seen;
+    }
+}
+
+#else
+
+static void objpool_push_chain(ObjPool* pool, ObjPoolSlot* first, ObjPoolSlot* last) {
+    __htfh_lock_lock(&pool->mutex);
+    last->next = head_slot(pool->free_list);
+    pool->free_list = (objpool_head_t) first;
+    __htfh_lock_unlock(&pool->mutex);
+}
+
+static ObjPoolSlot* objpool_pop(ObjPool* pool) {
+    __htfh_lock_lock(&pool->mutex);
+    ObjPoolSlot* slot = head_slot(pool->free_list);
+    if (slot != NULL) {
+        pool->free_list = (objpool_head_t) slot->next;
+    }
+    __htfh_lock_unlock(&pool->mutex);
+    return slot;
+}
+
+static ObjPoolSlot* objpool_take_all(ObjPool* pool) {
+    __htfh_lock_lock(&pool->mutex);
+    ObjPoolSlot* slot = head_slot(pool->free_list);
+    pool->free_list = 0;
+    __htfh_lock_unlock(&pool->mutex);
+    return slot;
+}
+
+#endif
+
+static inline ObjPoolSlab* objpool_slab_of(const ObjPool* pool, const void* ptr) {
+    return (ObjPoolSlab*) ((uintptr_t) ptr & ~(uintptr_t) (pool->slab_size - 1));
+}
+
+/* Take a new slab from the heap and push its slots, unless another thread already did. */
+static int objpool_grow(ObjPool* pool) {
+    if (__htfh_lock_lock_handled(&pool->mutex) != 0) {
+        return -1;
+    } else if (head_slot(pool->free_list) != NULL) {
+        return __htfh_lock_unlock_handled(&pool->mutex);
+    }
+    ObjPoolSlab* slab = htfh_memalign(pool->alloc, pool->slab_size, pool->slab_size);
+    if (slab == NULL) {
+        __htfh_lock_unlock_handled(&pool->mutex);
+        return -1;
+    }
+    slab->pool = pool;
+    slab->live = 0;
+    slab->free_count = 0;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    ObjPoolSlot* first = (ObjPoolSlot*) ((char*) slab + pool->slot_offset);
+    ObjPoolSlot* last = first;
+    for (size_t i = 1; i < pool->slots_per_slab; i++) {
+        ObjPoolSlot* slot = (ObjPoolSlot*) ((char*) last + pool->stride);
+        last->next = slot;
+        last = slot;
+    }
+    objpool_push_chain(pool, first, last);
+    return __htfh_lock_unlock_handled(&pool->mutex);
+}
+
+/* Release empty slabs but one, the caller must hold the pool mutex. */
+static int objpool_release_empty(ObjPool* pool) {
+    ObjPoolSlot* slots = objpool_take_all(pool);
+    for (ObjPoolSlab* slab = pool->slabs; slab != NULL; slab = slab->next) {
+        slab->free_count = 0;
+    }
+    for (ObjPoolSlot* slot = slots; slot != NULL; slot = slot->next) {
+        objpool_slab_of(pool, slot)->free_count++;
+    }
+    /*
+    ** Keep one empty slab in reserve so a pool hovering at a boundary does
+    ** not thrash, its count is cleared so the slab is not released below.
+    */
+    int reserve = 1;
+    for (ObjPoolSlab* slab = pool->slabs; slab != NULL; slab = slab->next) {
+        if (slab->free_count == pool->slots_per_slab && reserve) {
+            reserve = 0;
+            slab->free_count = 0;
+        }
+    }
+    /* Rebuild the free stack without the slots of slabs about to be released. */
+    ObjPoolSlot* first = NULL;
+    ObjPoolSlot* last = NULL;
+    while (slots != NULL) {
+        ObjPoolSlot* next = slots->next;
+        if (objpool_slab_of(pool, slots)->free_count != pool->slots_per_slab) {
+            slots->next = first;
+            first = slots;
+            last = last == NULL ? slots : last;
+        }
+        slots = next;
+    }
+    int status = 0;
+    ObjPoolSlab** link = &pool->slabs;
+    while (*link != NULL) {
+        ObjPoolSlab* slab = *link;
+        if (slab->free_count != pool->slots_per_slab) {
+            link = &slab->next;
+            continue;
+        }
+        *link = slab->next;
+        pool->slab_count--;
+        if (htfh_free(pool->alloc, slab) != 0) {
+            status = -1;
+        }
+    }
+    if (first != NULL) {
+        objpool_push_chain(pool, first, last);
+    }
+    __atomic_store_n(&pool->empty_events, 0, __ATOMIC_RELAXED);
+    return status;
+}
+
+ObjPool* htfh_objpool_create(Allocator* alloc, size_t obj_size, size_t align) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    } else if (!obj_size) {
+        set_alloc_errno(NON_ZERO_BLOCK_SIZE);
+        return NULL;
+    } else if ((align & (align - 1)) != 0) {
+        set_alloc_errno(ALIGN_POWER_OF_TWO);
+        return NULL;
+    }
+    align = htfh_max(htfh_max(align, (size_t) ALIGN_SIZE), _Alignof(ObjPoolSlot));
+    const size_t stride = align_up(htfh_max(obj_size, sizeof(ObjPoolSlot)), align);
+    const size_t slot_offset = align_up(sizeof(ObjPoolSlab), align);
+    size_t slab_size = OBJPOOL_SLAB_SIZE_MIN;
+    /* Fit at least a handful of objects per slab. */
+    while (slab_size < slot_offset + 8 * stride) {
+        slab_size <<= 1;
+    }
+
+    ObjPool* pool = htfh_memalign(alloc, _Alignof(ObjPool), sizeof(*pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    int lock_result;
+    if ((lock_result = __htfh_lock_init(&pool->mutex, PTHREAD_MUTEX_RECURSIVE)) != 0) {
+        set_alloc_errno_msg(MUTEX_LOCK_INIT, strerror(lock_result));
+        htfh_free(alloc, pool);
+        return NULL;
+    }
+    pool->free_list = 0;
+    pool->alloc = alloc;
+    pool->stride = stride;
+    pool->slab_size = slab_size;
+    pool->slot_offset = slot_offset;
+    pool->slots_per_slab = (slab_size - slot_offset) / stride;
+    pool->slabs = NULL;
+    pool->slab_count = 0;
+    pool->empty_events = 0;
+    return pool;
+}
+
+int htfh_objpool_destroy(ObjPool* pool) {
+    if (pool == NULL) {
+        set_alloc_errno(NULL_OBJPOOL_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&pool->mutex) != 0) {
+        return -1;
+    }
+    int status = 0;
+    while (pool->slabs != NULL) {
+        ObjPoolSlab* next = pool->slabs->next;
+        if (htfh_free(pool->alloc, pool->slabs) != 0) {
+            status = -1;
+        }
+        pool->slabs = next;
+    }
+    if (__htfh_lock_unlock_handled(&pool->mutex) != 0) {
+        return -1;
+    } else if (__htfh_lock_destroy(&pool->mutex) != 0) {
+        set_alloc_errno(MUTEX_LOCK_DESTROY);
+        status = -1;
+    }
+    return htfh_free(pool->alloc, pool) == 0 ? status : -1;
+}
+
+void* htfh_objpool_alloc(ObjPool* pool) {
+    if (pool == NULL) {
+        set_alloc_errno(NULL_OBJPOOL_INSTANCE);
+        return NULL;
+    }
+    ObjPoolSlot* slot;
+    while ((slot = objpool_pop(pool)) == NULL) {
+        if (objpool_grow(pool) != 0) {
+            return NULL;
+        }
+    }
+    __atomic_add_fetch(&objpool_slab_of(pool, slot)->live, 1, __ATOMIC_RELAXED);
+    return slot;
+}
+
+int htfh_objpool_free(ObjPool* pool, void* ptr) {
+    if (pool == NULL) {
+        set_alloc_errno(NULL_OBJPOOL_INSTANCE);
+        return -1;
+    } else if (ptr == NULL) {
+        return 0;
+    }
+    ObjPoolSlab* slab = objpool_slab_of(pool, ptr);
+    if (slab->pool != pool) {
+        set_alloc_errno(PTR_NOT_IN_OBJPOOL);
+        return -1;
+    }
+    /*
+    ** The count drops before the slot is published: once the slot is on the
+    ** free stack another thread may pop and free it and trim the slab away,
+    ** so the slab must not be touched after the push.
+    */
+    const size_t live = __atomic_sub_fetch(&slab->live, 1, __ATOMIC_RELAXED);
+    objpool_push_chain(pool, ptr, ptr);
+    if (live != 0) {
+        return 0;
+    }
+    /*
+    ** Trimming walks the free stack, so it is amortised over as many
+    ** emptied slabs as the pool holds and skipped if another thread is
+    ** already growing or trimming.
+    */
+    const size_t events = __atomic_add_fetch(&pool->empty_events, 1, __ATOMIC_RELAXED);
+    if (events < htfh_max(pool->slab_count, (size_t) 2) || __htfh_lock_trylock_handled(&pool->mutex) != 0) {
+        return 0;
+    }
+    const int status = objpool_release_empty(pool);
+    return __htfh_lock_unlock_handled(&pool->mutex) == 0 ? status : -1;
+}
+
+int htfh_objpool_trim(ObjPool* pool) {
+    if (pool == NULL) {
+        set_alloc_errno(NULL_OBJPOOL_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&pool->mutex) != 0) {
+        return -1;
+    }
+    const int status = objpool_release_empty(pool);
+    return __htfh_lock_unlock_handled(&pool->mutex) == 0 ? status : -1;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_OBJPOOL_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_OBJPOOL_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "htfh.h"
+
+/*
+** Fixed-size object pool on top of an allocator.
+**
+** Slabs of OBJPOOL_SLAB_SIZE_MIN bytes or more are taken from the heap,
+** aligned to their own power of two size so that the owning slab of any
+** object is found by masking its address. Slabs are cut into slots of
+** exactly the object size (rounded to the requested alignment) without a
+** per-object header. Free slots form an intrusive stack that is updated
+** with a double-width compare-and-swap, tagged against ABA, where the
+** platform provides one and under the pool mutex otherwise. Slabs whose
+** objects have all been freed are returned to the heap.
+*/
+
+#if defined(ARCH_64_BIT) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define OBJPOOL_LOCK_FREE
+typedef unsigned __int128 objpool_head_t;
+#elif !defined(ARCH_64_BIT) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)
+#define OBJPOOL_LOCK_FREE
+typedef unsigned long long objpool_head_t;
+#else
+typedef uintptr_t objpool_head_t;
+#endif
+
+typedef struct ObjPoolSlot {
+    struct ObjPoolSlot* next;
+} ObjPoolSlot;
+
+typedef struct ObjPoolSlab {
+    struct ObjPoolSlab* next;
+    struct ObjPool* pool;
+    /* Objects currently handed out from this slab, updated atomically. */
+    size_t live;
+    /* Free slots counted while trimming, guarded by the pool mutex. */
+    size_t free_count;
+} ObjPoolSlab;
+
+typedef struct ObjPool {
+    /* Free slot stack, the low half holds the slot and the high half an ABA tag. */
+    volatile objpool_head_t free_list;
+    /* Guards the slab list, growth and trimming. */
+    __htfh_lock_t mutex;
+    Allocator* alloc;
+    size_t stride;
+    size_t slab_size;
+    size_t slot_offset;
+    size_t slots_per_slab;
+    ObjPoolSlab* slabs;
+    size_t slab_count;
+    /* Slabs that became empty since the last trim, updated atomically. */
+    size_t empty_events;
+} ObjPool;
+
+/* Create a pool of obj_size byte objects aligned to align (0 for ALIGN_SIZE). */
+ObjPool* htfh_objpool_create(Allocator* alloc, size_t obj_size, size_t align);
+/* Return every slab and the pool itself to the heap, live objects included. */
+int htfh_objpool_destroy(ObjPool* pool);
+
+__attribute__((malloc)) void* htfh_objpool_alloc(ObjPool* pool);
+int htfh_objpool_free(ObjPool* pool, void* ptr);
+
+/* Return all empty slabs but one to the heap. */
+int htfh_objpool_trim(ObjPool* pool);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_OBJPOOL_
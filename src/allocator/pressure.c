@@ -0,0 +1,85 @@
+#include "pressure.h"
+
+/* Set while this thread runs a reclaim callback, so that reclaim does not recurse. */
+static __thread int reclaiming = 0;
+
+static int pressure_level(const HeapPressure* pressure, size_t used) {
+    if (used >= pressure->high) {
+        return PRESSURE_HIGH;
+    } else if (used >= pressure->low) {
+        return PRESSURE_LOW;
+    }
+    return PRESSURE_NONE;
+}
+
+int htfh_set_watermarks(Allocator* alloc, size_t low, size_t high, htfh_pressure_callback callback, void* user) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (low > high) {
+        set_alloc_errno(INVALID_WATERMARKS);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    alloc->pressure.low = low;
+    alloc->pressure.high = high;
+    alloc->pressure.user = user;
+    /* The first call afterwards reports the level the heap is at, if raised. */
+    __atomic_store_n(&alloc->pressure.level, PRESSURE_NONE, __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc->pressure.callback, callback, __ATOMIC_RELEASE);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_set_reclaim(Allocator* alloc, htfh_reclaim_callback reclaim, void* user) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    alloc->pressure.reclaim_user = user;
+    __atomic_store_n(&alloc->pressure.reclaim, reclaim, __ATOMIC_RELEASE);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+size_t htfh_used_bytes(Allocator* alloc) {
+    if (alloc == NULL || alloc->controller == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return 0;
+    }
+    const size_t pool_bytes = __atomic_load_n(&alloc->pool_bytes, __ATOMIC_RELAXED);
+    const size_t free_bytes = __atomic_load_n(&alloc->controller->free_bytes, __ATOMIC_RELAXED);
+    /* Read without the lock, a pool being added or removed may be seen half way. */
+    return pool_bytes > free_bytes ? pool_bytes - free_bytes : 0;
+}
+
+void pressure_notify(Allocator* alloc) {
+    HeapPressure* pressure = &alloc->pressure;
+    const htfh_pressure_callback callback = __atomic_load_n(&pressure->callback, __ATOMIC_ACQUIRE);
+    if (callback == NULL) {
+        return;
+    }
+    const size_t used = htfh_used_bytes(alloc);
+    const int level = pressure_level(pressure, used);
+    int reported = __atomic_load_n(&pressure->level, __ATOMIC_RELAXED);
+    /* Of the threads seeing the same change, only the one swapping the level reports it. */
+    if (level != reported
+        && __atomic_compare_exchange_n(&pressure->level, &reported, level, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        callback(alloc, level, used, pressure->user);
+    }
+}
+
+int pressure_reclaim(Allocator* alloc, size_t bytes) {
+    if (alloc == NULL || reclaiming || __htfh_lock_depth != 0) {
+        return 0;
+    }
+    const htfh_reclaim_callback reclaim = __atomic_load_n(&alloc->pressure.reclaim, __ATOMIC_ACQUIRE);
+    if (reclaim == NULL) {
+        return 0;
+    }
+    reclaiming = 1;
+    const size_t released = reclaim(alloc, bytes, alloc->pressure.reclaim_user);
+    reclaiming = 0;
+    return released != 0;
+}
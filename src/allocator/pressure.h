@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_PRESSURE_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_PRESSURE_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "htfh.h"
+
+/*
+** Memory pressure watermarks and reclaim callbacks.
+**
+** Used bytes are the usable bytes of all registered pools less those on
+** the free lists, so block headers and blocks held on quick-lists count
+** as used and direct-mapped blocks do not count at all. They are kept
+** current in O(1) by the free list insert and remove paths.
+**
+** Below the low watermark the heap is at PRESSURE_NONE, from low up to
+** the high watermark at PRESSURE_LOW, and from high upwards at
+** PRESSURE_HIGH. When an allocation, free or realloc leaves the heap at
+** a different level than last reported, the pressure callback is run
+** with the new level on return, after the allocator lock is released.
+** Calls made while the calling thread holds the lock, such as those
+** from handle table operations, defer the callback to the next call
+** made without it. Concurrent threads report each change once.
+**
+** A reclaim callback is run when htfh_malloc or htfh_memalign are about
+** to fail, again outside the lock. It should free memory, for example
+** by evicting cache entries, and return the number of bytes it
+** released. If it released any, the allocation is retried once. A
+** reclaim callback never runs from within another on the same thread.
+*/
+
+/*
+** Set the watermarks on used bytes and the callback reporting level
+** changes, a NULL callback disables them. Requires low <= high.
+*/
+int htfh_set_watermarks(Allocator* alloc, size_t low, size_t high, htfh_pressure_callback callback, void* user);
+/* Set the callback run before a failing allocation is retried, NULL disables. */
+int htfh_set_reclaim(Allocator* alloc, htfh_reclaim_callback reclaim, void* user);
+/* Bytes in use in the allocator's pools, read without the lock. */
+size_t htfh_used_bytes(Allocator* alloc);
+
+/* Report a level change if the calling thread holds no allocator lock. */
+void pressure_notify(Allocator* alloc);
+/* Run the reclaim callback for a failed request, nonzero if it released anything. */
+int pressure_reclaim(Allocator* alloc, size_t bytes);
+
+static inline void pressure_check(Allocator* alloc) {
+    if (alloc != NULL && alloc->pressure.callback != NULL && __htfh_lock_depth == 0) {
+        pressure_notify(alloc);
+    }
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_PRESSURE_
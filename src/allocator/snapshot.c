@@ -0,0 +1,194 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "snapshot.h"
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Pagemap entries read per batch while looking for modified pages. */
+#define PAGEMAP_BATCH 512
+#define PAGEMAP_PRESENT ((uint64_t) 1 << 63)
+#define PAGEMAP_SWAPPED ((uint64_t) 1 << 62)
+#define PAGEMAP_FILE ((uint64_t) 1 << 61)
+
+static int remap_heap(Allocator* alloc, int flags) {
+    void* heap = mmap(
+        alloc->heap,
+        alloc->heap_size,
+        PROT_READ | PROT_WRITE,
+        flags | MAP_FIXED,
+        alloc->heap_fd,
+        0
+    );
+    if (heap == MAP_FAILED) {
+        set_alloc_errno_msg(SNAPSHOT_MAP_FAILED, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int write_back_range(Allocator* alloc, size_t offset, size_t length) {
+    const char* src = (const char*) alloc->heap + offset;
+    length = htfh_min(length, alloc->heap_size - offset);
+    while (length > 0) {
+        const ssize_t written = pwrite(alloc->heap_fd, src, length, (off_t) offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            set_alloc_errno_msg(SNAPSHOT_MAP_FAILED, strerror(errno));
+            return -1;
+        }
+        src += written;
+        offset += (size_t) written;
+        length -= (size_t) written;
+    }
+    return 0;
+}
+
+/*
+** Copy the pages privately modified since the snapshot back into the memfd.
+** A page that was written has been replaced by an anonymous copy, which the
+** pagemap reports as not file backed. Without a readable pagemap every page
+** is copied.
+*/
+static int write_back(Allocator* alloc) {
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t pages = align_up(alloc->heap_size, page_size) / page_size;
+    const size_t first_page = (uintptr_t) alloc->heap / page_size;
+    const int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemap == -1) {
+        return write_back_range(alloc, 0, alloc->heap_size);
+    }
+    uint64_t entries[PAGEMAP_BATCH];
+    int status = 0;
+    for (size_t page = 0; page < pages && status == 0; page += PAGEMAP_BATCH) {
+        const size_t count = htfh_min((size_t) PAGEMAP_BATCH, pages - page);
+        const ssize_t bytes = pread(
+            pagemap,
+            entries,
+            count * sizeof(entries[0]),
+            (off_t) ((first_page + page) * sizeof(entries[0]))
+        );
+        if (bytes != (ssize_t) (count * sizeof(entries[0]))) {
+            status = write_back_range(alloc, page * page_size, count * page_size);
+            continue;
+        }
+        for (size_t i = 0; i < count && status == 0; i++) {
+            const uint64_t entry = entries[i];
+            if (((entry & PAGEMAP_PRESENT) && !(entry & PAGEMAP_FILE)) || (entry & PAGEMAP_SWAPPED)) {
+                status = write_back_range(alloc, (page + i) * page_size, page_size);
+            }
+        }
+    }
+    close(pagemap);
+    return status;
+}
+
+HeapSnapshot* htfh_snapshot(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    } else if (alloc->heap_fd == -1) {
+        set_alloc_errno(HEAP_NOT_SNAPSHOTTABLE);
+        return NULL;
+    } else if (alloc->realtime) {
+        /* Copy-on-write would fault on the first write to every page. */
+        set_alloc_errno(HEAP_REALTIME);
+        return NULL;
+    }
+    HeapSnapshot* snapshot = malloc(sizeof(*snapshot));
+    if (snapshot == NULL) {
+        set_alloc_errno(MALLOC_FAILED);
+        return NULL;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        free(snapshot);
+        return NULL;
+    } else if (alloc->snapshot != NULL) {
+        set_alloc_errno(SNAPSHOT_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        free(snapshot);
+        return NULL;
+    }
+    void* view = mmap(NULL, alloc->heap_size, PROT_READ, MAP_SHARED, alloc->heap_fd, 0);
+    if (view == MAP_FAILED) {
+        set_alloc_errno_msg(SNAPSHOT_MAP_FAILED, strerror(errno));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        free(snapshot);
+        return NULL;
+    } else if (remap_heap(alloc, MAP_PRIVATE) != 0) {
+        munmap(view, alloc->heap_size);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->alloc = alloc;
+    snapshot->heap = view;
+    snapshot->heap_size = alloc->heap_size;
+    alloc->snapshot = snapshot;
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return NULL;
+    }
+    return snapshot;
+}
+
+int htfh_snapshot_release(HeapSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        set_alloc_errno(NULL_SNAPSHOT_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = snapshot->alloc;
+    /*
+    ** The view is only unmapped once the heap is shared again, so a failed
+    ** release leaves the snapshot usable and may be retried.
+    */
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (mprotect(alloc->heap, alloc->heap_size, PROT_READ) != 0) {
+        set_alloc_errno_msg(SNAPSHOT_MAP_FAILED, strerror(errno));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (write_back(alloc) != 0 || remap_heap(alloc, MAP_SHARED) != 0) {
+        mprotect(alloc->heap, alloc->heap_size, PROT_READ | PROT_WRITE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    } else if (munmap((void*) snapshot->heap, snapshot->heap_size) != 0) {
+        set_alloc_errno_msg(SNAPSHOT_MAP_FAILED, strerror(errno));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    alloc->snapshot = NULL;
+    free(snapshot);
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+const Controller* htfh_snapshot_controller(const HeapSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        set_alloc_errno(NULL_SNAPSHOT_INSTANCE);
+        return NULL;
+    }
+    return htfh_snapshot_translate(snapshot, snapshot->alloc->controller);
+}
+
+void* htfh_snapshot_pool(const HeapSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        set_alloc_errno(NULL_SNAPSHOT_INSTANCE);
+        return NULL;
+    }
+    return (char*) snapshot->heap + htfh_size();
+}
+
+const void* htfh_snapshot_translate(const HeapSnapshot* snapshot, const void* ptr) {
+    if (snapshot == NULL) {
+        set_alloc_errno(NULL_SNAPSHOT_INSTANCE);
+        return NULL;
+    }
+    const ptrdiff_t offset = (const char*) ptr - (const char*) snapshot->alloc->heap;
+    if (offset < 0 || (size_t) offset >= snapshot->heap_size) {
+        return NULL;
+    }
+    return (const char*) snapshot->heap + offset;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_SNAPSHOT_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_SNAPSHOT_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "htfh.h"
+
+/*
+** Copy-on-write heap snapshots.
+**
+** For a heap created with HTFH_CREATE_MEMFD, a snapshot maps the memfd a
+** second time read-only and remaps the live heap privately over the same
+** file. From then on the file, and with it the snapshot, stays frozen
+** while every write to the live heap lands in a private copy of the page
+** it touches. Taking a snapshot costs two mappings, independent of the
+** heap size, and the view can be walked or written out from another
+** thread while the application keeps allocating.
+**
+** Releasing the snapshot scans /proc/self/pagemap over the whole heap,
+** eight bytes per page, copies every page modified since back into the
+** memfd and maps the live heap shared again. Its cost grows with the heap
+** size as well as with the pages modified. Only one snapshot may be
+** active at a time.
+*/
+typedef struct HeapSnapshot {
+    Allocator* alloc;
+    /* Read-only view of the heap, controller included. */
+    const void* heap;
+    size_t heap_size;
+} HeapSnapshot;
+
+HeapSnapshot* htfh_snapshot(Allocator* alloc);
+/*
+** Fold the changes made since the snapshot back into the heap and drop
+** the snapshot. The caller must first stop every thread that may store
+** to the heap, including stores into allocated blocks and lock-free
+** object pools: a store landing between the copy and the remap would be
+** lost. To make such a store fail loudly rather than vanish, the heap is
+** read-only while the release runs and a racing store faults.
+*/
+int htfh_snapshot_release(HeapSnapshot* snapshot);
+
+/* Controller at the time of the snapshot, its pointers refer to the live heap. */
+const Controller* htfh_snapshot_controller(const HeapSnapshot* snapshot);
+/* Primary pool of the snapshot, for use with htfh_walk_pool and htfh_check_pool. */
+void* htfh_snapshot_pool(const HeapSnapshot* snapshot);
+/* Translate an address in the live heap to the same location in the snapshot. */
+const void* htfh_snapshot_translate(const HeapSnapshot* snapshot, const void* ptr);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_SNAPSHOT_
@@ -0,0 +1,27 @@
+#include "htfh.h"
+
+#ifdef STATIC_CFH
+
+#include <stdalign.h>
+
+/* Zero initialised, so the heap occupies .bss rather than the binary. */
+static alignas(Allocator) unsigned char static_cfh_storage[sizeof(Allocator) + 2 * sizeof(max_align_t) + STATIC_CFH_HEAP_SIZE];
+static Allocator* static_cfh_alloc = NULL;
+
+__attribute__((constructor(STATIC_CFH_CONSTRUCTOR_PRIORITY)))
+static void static_cfh_construct(void) {
+    static_cfh_alloc = htfh_create_in_place(static_cfh_storage, sizeof(static_cfh_storage));
+}
+
+__attribute__((destructor(STATIC_CFH_DESTRUCTOR_PRIORITY)))
+static void static_cfh_destruct(void) {
+    if (static_cfh_alloc != NULL && htfh_destroy(static_cfh_alloc) == 0) {
+        static_cfh_alloc = NULL;
+    }
+}
+
+Allocator* htfh_static_allocator(void) {
+    return static_cfh_alloc;
+}
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Samples are copied a word at a time so that a torn copy is detected rather than undefined. */
+_Static_assert(sizeof(HeapStatsSample) % sizeof(uint64_t) == 0, "HeapStatsSample must be a whole number of words");
+
+#define STATS_SAMPLE_WORDS (sizeof(HeapStatsSample) / sizeof(uint64_t))
+
+static uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* Take a sample and write it to the page, only ever run by one thread at a time. */
+static void stats_sample(HeapStats* stats) {
+    Allocator* alloc = stats->alloc;
+    HeapStatsSample sample;
+    memset(&sample, 0, sizeof(sample));
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return;
+    }
+    const Controller* control = alloc->controller;
+    sample.pool_bytes = alloc->pool_bytes;
+    sample.free_bytes = control->free_bytes;
+    sample.fl_bitmap = control->fl_bitmap;
+    memcpy(sample.sl_bitmap, control->sl_bitmap, sizeof(sample.sl_bitmap));
+    __htfh_lock_unlock_handled(&alloc->mutex);
+    sample.used_bytes = sample.pool_bytes > sample.free_bytes ? sample.pool_bytes - sample.free_bytes : 0;
+    for (size_t i = 0; i < STATS_COUNTER_COUNT; i++) {
+        sample.counters[i] = __atomic_load_n(&alloc->counters[i], __ATOMIC_RELAXED);
+    }
+    sample.time_ns = stats_now_ns();
+
+    HeapStatsPage* page = stats->page;
+    const uint64_t seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    /* Readers seeing any word of the new sample also see the odd sequence. */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    const uint64_t* src = (const uint64_t*) &sample;
+    uint64_t* dst = (uint64_t*) &page->sample;
+    for (size_t i = 0; i < STATS_SAMPLE_WORDS; i++) {
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void* stats_publisher(void* arg) {
+    HeapStats* stats = (HeapStats*) arg;
+    pthread_mutex_lock(&stats->mutex);
+    while (!stats->stopping) {
+        pthread_mutex_unlock(&stats->mutex);
+        stats_sample(stats);
+        pthread_mutex_lock(&stats->mutex);
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += stats->interval_ms / 1000;
+        deadline.tv_nsec += (long) (stats->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!stats->stopping && pthread_cond_timedwait(&stats->cond, &stats->mutex, &deadline) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&stats->mutex);
+    return NULL;
+}
+
+/* Create, size and map the segment, filling in the page header. */
+static int stats_segment_create(HeapStats* stats, const char* name) {
+    if (name != NULL) {
+        if (strlen(name) >= sizeof(stats->name)) {
+            set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(ENAMETOOLONG));
+            return -1;
+        }
+        strcpy(stats->name, name);
+        stats->fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    } else {
+        stats->name[0] = '\0';
+        stats->fd = memfd_create("htfh-stats", MFD_CLOEXEC);
+    }
+    if (stats->fd == -1) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        return -1;
+    }
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    stats->page_bytes = align_up(sizeof(HeapStatsPage), page_size);
+    if (ftruncate(stats->fd, (off_t) stats->page_bytes) != 0
+        || (stats->page = mmap(NULL, stats->page_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, stats->fd, 0)) == MAP_FAILED) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        close(stats->fd);
+        if (name != NULL) {
+            shm_unlink(name);
+        }
+        return -1;
+    }
+    HeapStatsPage* page = stats->page;
+    memset(page, 0, sizeof(*page));
+    page->version = STATS_VERSION;
+    page->sample_size = sizeof(HeapStatsSample);
+    page->pid = (uint64_t) getpid();
+    page->interval_ms = stats->interval_ms;
+    page->fl_index_count = FL_INDEX_COUNT;
+    page->sl_index_count_log2 = SL_INDEX_COUNT_LOG2;
+    page->fl_index_shift = FL_INDEX_SHIFT;
+    stats_sample(stats);
+    /* Written last, a reader that recognises the segment finds it complete. */
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(page->magic, STATS_MAGIC, sizeof(page->magic));
+    return 0;
+}
+
+static void stats_segment_destroy(HeapStats* stats) {
+    munmap(stats->page, stats->page_bytes);
+    close(stats->fd);
+    if (stats->name[0] != '\0') {
+        shm_unlink(stats->name);
+    }
+}
+
+int htfh_stats_publish(Allocator* alloc, const char* name, unsigned int interval_ms) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    }
+    HeapStats* stats = malloc(sizeof(*stats));
+    if (stats == NULL) {
+        set_alloc_errno(MALLOC_FAILED);
+        return -1;
+    }
+    stats->alloc = alloc;
+    stats->interval_ms = interval_ms ? interval_ms : STATS_INTERVAL_MS_DEFAULT;
+    stats->stopping = 0;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&stats->mutex, NULL);
+    pthread_cond_init(&stats->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    /* Held while the segment is created, so that a second publish cannot take over its name. */
+    int result;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        result = -1;
+    } else if (alloc->stats != NULL) {
+        set_alloc_errno(STATS_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        result = -1;
+    } else if (stats_segment_create(stats, name) != 0) {
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        result = -1;
+    } else if ((result = pthread_create(&stats->publisher, NULL, stats_publisher, stats)) != 0) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(result));
+        stats_segment_destroy(stats);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+    } else {
+        alloc->stats = stats;
+        return __htfh_lock_unlock_handled(&alloc->mutex);
+    }
+    pthread_cond_destroy(&stats->cond);
+    pthread_mutex_destroy(&stats->mutex);
+    free(stats);
+    return -1;
+}
+
+int htfh_stats_unpublish(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    HeapStats* stats = alloc->stats;
+    alloc->stats = NULL;
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (stats == NULL) {
+        set_alloc_errno(STATS_NOT_ACTIVE);
+        return -1;
+    }
+    pthread_mutex_lock(&stats->mutex);
+    stats->stopping = 1;
+    pthread_cond_signal(&stats->cond);
+    pthread_mutex_unlock(&stats->mutex);
+    pthread_join(stats->publisher, NULL);
+    pthread_cond_destroy(&stats->cond);
+    pthread_mutex_destroy(&stats->mutex);
+    stats_segment_destroy(stats);
+    free(stats);
+    return 0;
+}
+
+int htfh_stats_fd(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (alloc->stats == NULL) {
+        set_alloc_errno(STATS_NOT_ACTIVE);
+        return -1;
+    }
+    return alloc->stats->fd;
+}
+
+const HeapStatsPage* htfh_stats_attach(const char* name) {
+    if (name == NULL || name[0] == '\0') {
+        set_alloc_errno(STATS_INVALID_SEGMENT);
+        return NULL;
+    }
+    const int fd = strchr(name + 1, '/') == NULL
+        ? shm_open(name, O_RDONLY | O_CLOEXEC, 0)
+        : open(name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        close(fd);
+        return NULL;
+    } else if ((size_t) st.st_size < sizeof(HeapStatsPage)) {
+        set_alloc_errno(STATS_INVALID_SEGMENT);
+        close(fd);
+        return NULL;
+    }
+    /* Readers map the segment read-only, they cannot disturb the publisher. */
+    const HeapStatsPage* page = mmap(NULL, sizeof(HeapStatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        return NULL;
+    } else if (memcmp(page->magic, STATS_MAGIC, sizeof(page->magic)) != 0
+        || page->version != STATS_VERSION
+        || page->sample_size != sizeof(HeapStatsSample)
+        || page->fl_index_count != FL_INDEX_COUNT) {
+        set_alloc_errno(STATS_INVALID_SEGMENT);
+        munmap((void*) page, sizeof(HeapStatsPage));
+        return NULL;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return page;
+}
+
+int htfh_stats_detach(const HeapStatsPage* page) {
+    if (page == NULL) {
+        set_alloc_errno(STATS_INVALID_SEGMENT);
+        return -1;
+    } else if (munmap((void*) page, sizeof(HeapStatsPage)) != 0) {
+        set_alloc_errno_msg(STATS_SEGMENT_FAILED, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int htfh_stats_read(const HeapStatsPage* page, HeapStatsSample* sample) {
+    if (page == NULL || sample == NULL) {
+        set_alloc_errno(STATS_INVALID_SEGMENT);
+        return -1;
+    }
+    const uint64_t* src = (const uint64_t*) &page->sample;
+    uint64_t* dst = (uint64_t*) sample;
+    for (int attempt = 0; attempt < STATS_READ_RETRIES; attempt++) {
+        const uint64_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < STATS_SAMPLE_WORDS; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        /* Orders the copy before the second read of the sequence. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+            return 0;
+        }
+    }
+    set_alloc_errno(STATS_SAMPLE_BUSY);
+    return -1;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_STATS_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_STATS_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "htfh.h"
+
+/*
+** Shared memory statistics segment.
+**
+** While statistics are published, a publisher thread samples the
+** allocator every interval and writes the sample to a segment that other
+** processes can map read-only. The segment is a POSIX shared memory
+** object, or a memfd readable through /proc/<pid>/fd/<fd> if no name is
+** given.
+**
+** A sample holds the used and free bytes of the pools, the free list
+** bitmaps, and cumulative counts of mallocs, frees, reallocs and
+** allocations refused with HEAP_FULL. Readers derive rates from the
+** counts of successive samples. The bitmaps show which size classes have
+** a free block. The highest one set bounds the largest free block from
+** below, which gives an estimate of fragmentation.
+**
+** The monitored process pays one relaxed atomic increment per call and
+** holds the allocator lock for a moment at each sample. Counting covers
+** the public calls, so a moving realloc also counts the malloc and free
+** it makes. Samples are written under a sequence lock: readers retry
+** until they copy a whole sample without the publisher writing it, and
+** never write to the segment.
+*/
+
+#define STATS_MAGIC "HTFHSTA1"
+#define STATS_VERSION 1
+
+/* Interval between samples when none is given, in milliseconds. */
+#define STATS_INTERVAL_MS_DEFAULT 100
+/* Attempts to read a consistent sample before giving up. */
+#define STATS_READ_RETRIES 1000
+
+typedef struct HeapStatsSample {
+    /* CLOCK_MONOTONIC time the sample was taken, in nanoseconds. */
+    uint64_t time_ns;
+    /* Usable bytes of the registered pools, and of those the bytes in use and on the free lists. */
+    uint64_t pool_bytes;
+    uint64_t used_bytes;
+    uint64_t free_bytes;
+    /* Calls counted while statistics have been published, indexed by htfh_stats_counter. */
+    uint64_t counters[STATS_COUNTER_COUNT];
+    /* Free list bitmaps of the controller, a bit is set while its list is non-empty. */
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[FL_INDEX_COUNT];
+} HeapStatsSample;
+
+typedef struct HeapStatsPage {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_size;
+    uint64_t pid;
+    uint32_t interval_ms;
+    /* Size class geometry needed to interpret the bitmaps. */
+    uint32_t fl_index_count;
+    uint32_t sl_index_count_log2;
+    uint32_t fl_index_shift;
+    /* Odd while the publisher is writing the sample. */
+    uint64_t seq;
+    HeapStatsSample sample;
+} HeapStatsPage;
+
+typedef struct HeapStats {
+    Allocator* alloc;
+    HeapStatsPage* page;
+    size_t page_bytes;
+    int fd;
+    /* Shared memory object name, empty for a memfd. */
+    char name[NAME_MAX + 1];
+    unsigned int interval_ms;
+    /* Wakes the publisher early when stopping. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t publisher;
+    int stopping;
+} HeapStats;
+
+/*
+** Publish the allocator's statistics to the shared memory object name,
+** created or replaced with mode 0644, or to a memfd if name is NULL. A
+** sample is written every interval_ms, STATS_INTERVAL_MS_DEFAULT if 0.
+*/
+int htfh_stats_publish(Allocator* alloc, const char* name, unsigned int interval_ms);
+/* Stop publishing, unmap the segment and unlink its name. */
+int htfh_stats_unpublish(Allocator* alloc);
+/* File descriptor of the published segment, -1 if none. */
+int htfh_stats_fd(Allocator* alloc);
+
+/*
+** Map a published segment read-only. A name with no slash past the
+** first character is a shared memory object name, anything else a path
+** such as /proc/<pid>/fd/<fd>.
+*/
+const HeapStatsPage* htfh_stats_attach(const char* name);
+int htfh_stats_detach(const HeapStatsPage* page);
+/* Copy the latest sample, consistent as of a single publication. */
+int htfh_stats_read(const HeapStatsPage* page, HeapStatsSample* sample);
+
+static inline void stats_count(Allocator* alloc, enum htfh_stats_counter counter) {
+    if (alloc != NULL && alloc->stats != NULL) {
+        __atomic_add_fetch(&alloc->counters[counter], 1, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_STATS_
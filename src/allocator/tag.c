@@ -0,0 +1,105 @@
+#include "tag.h"
+#include <string.h>
+
+/* Location of the tag stored at the end of a block's payload. */
+static inline void* tag_slot(void* ptr, size_t usable) {
+    return (char*) ptr + usable - sizeof(htfh_tag_t);
+}
+
+/* Charge bytes to a tag, failing if they do not fit in its budget. */
+static int tag_charge(HeapTag* entry, size_t bytes) {
+    const size_t budget = __atomic_load_n(&entry->budget, __ATOMIC_RELAXED);
+    const size_t live = __atomic_add_fetch(&entry->live, bytes, __ATOMIC_RELAXED);
+    if (live > budget || live < bytes) {
+        __atomic_sub_fetch(&entry->live, bytes, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&entry->rejected, 1, __ATOMIC_RELAXED);
+        set_alloc_errno(TAG_OVER_BUDGET);
+        return -1;
+    }
+    size_t peak = __atomic_load_n(&entry->peak, __ATOMIC_RELAXED);
+    while (peak < live
+        && !__atomic_compare_exchange_n(&entry->peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 0;
+}
+
+int htfh_tag_set_budget(Allocator* alloc, htfh_tag_t tag, size_t bytes) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (tag >= TAG_COUNT_MAX) {
+        set_alloc_errno(INVALID_TAG);
+        return -1;
+    }
+    __atomic_store_n(&alloc->tags[tag].budget, bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int htfh_tag_stats(Allocator* alloc, htfh_tag_t tag, TagStats* stats) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (tag >= TAG_COUNT_MAX) {
+        set_alloc_errno(INVALID_TAG);
+        return -1;
+    }
+    const HeapTag* entry = &alloc->tags[tag];
+    stats->budget = __atomic_load_n(&entry->budget, __ATOMIC_RELAXED);
+    stats->live = __atomic_load_n(&entry->live, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&entry->peak, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&entry->rejected, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void* htfh_malloc_tagged(Allocator* alloc, htfh_tag_t tag, size_t bytes) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return NULL;
+    } else if (tag >= TAG_COUNT_MAX) {
+        set_alloc_errno(INVALID_TAG);
+        return NULL;
+    } else if (!bytes) {
+        set_alloc_errno(NON_ZERO_BLOCK_SIZE);
+        return NULL;
+    }
+    HeapTag* entry = &alloc->tags[tag];
+    const size_t request = bytes + sizeof(htfh_tag_t);
+    /* Fail fast, the block is never smaller than the request. */
+    if (request < bytes
+        || __atomic_load_n(&entry->live, __ATOMIC_RELAXED) + request
+            > __atomic_load_n(&entry->budget, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&entry->rejected, 1, __ATOMIC_RELAXED);
+        set_alloc_errno(TAG_OVER_BUDGET);
+        return NULL;
+    }
+    size_t usable;
+    void* ptr = htfh_malloc_usable(alloc, request, &usable);
+    if (ptr == NULL) {
+        return NULL;
+    } else if (tag_charge(entry, usable) != 0) {
+        htfh_free(alloc, ptr);
+        set_alloc_errno(TAG_OVER_BUDGET);
+        return NULL;
+    }
+    memcpy(tag_slot(ptr, usable), &tag, sizeof(tag));
+    return ptr;
+}
+
+int htfh_free_tagged(Allocator* alloc, void* ptr) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (ptr == NULL) {
+        return 0;
+    }
+    const size_t usable = block_size(block_from_ptr(ptr));
+    htfh_tag_t tag;
+    memcpy(&tag, tag_slot(ptr, usable), sizeof(tag));
+    if (tag >= TAG_COUNT_MAX) {
+        set_alloc_errno(INVALID_TAG);
+        return -1;
+    } else if (htfh_free(alloc, ptr) != 0) {
+        return -1;
+    }
+    __atomic_sub_fetch(&alloc->tags[tag].live, usable, __ATOMIC_RELAXED);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TAG_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TAG_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "htfh.h"
+
+/*
+** Per-tag byte budgets inside a single heap.
+**
+** Each allocation made through htfh_malloc_tagged is charged to one of
+** TAG_COUNT_MAX tags by the usable size of its block. The tag is stored
+** in the last bytes of the block, so the payload keeps its alignment and
+** htfh_free_tagged finds the tag to credit without any lookup. Counters
+** are updated atomically and never under the allocator mutex. A request
+** that cannot fit in what is left of its tag's budget fails with
+** TAG_OVER_BUDGET before the heap is touched; concurrent requests that
+** race past that check are rolled back once the block size is known.
+**
+** Tagged blocks must only be released with htfh_free_tagged and must not
+** be resized. Resetting the heap clears every tag's live bytes.
+*/
+
+typedef uint32_t htfh_tag_t;
+
+/* Budget and counters of a tag as of a single read. */
+typedef struct TagStats {
+    size_t budget;
+    size_t live;
+    size_t peak;
+    size_t rejected;
+} TagStats;
+
+/* Limit a tag to bytes usable bytes, SIZE_MAX removes the limit. */
+int htfh_tag_set_budget(Allocator* alloc, htfh_tag_t tag, size_t bytes);
+int htfh_tag_stats(Allocator* alloc, htfh_tag_t tag, TagStats* stats);
+
+/* Free a block from htfh_malloc_tagged, crediting its tag. */
+int htfh_free_tagged(Allocator* alloc, void* ptr);
+__attribute__((malloc
+#if __GNUC__ >= 10
+, malloc (htfh_free_tagged, 2)
+#endif
+)) __attribute__((alloc_size(3))) void* htfh_malloc_tagged(Allocator* alloc, htfh_tag_t tag, size_t bytes);
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TAG_
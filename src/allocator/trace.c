@@ -0,0 +1,266 @@
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t trace_sessions;
+
+/* Buffer of the calling thread in the trace it last recorded into. */
+static __thread TraceBuffer* trace_local;
+static __thread uint64_t trace_local_session;
+
+static int write_all(int fd, const void* data, size_t length) {
+    const char* src = data;
+    while (length > 0) {
+        const ssize_t written = write(fd, src, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written <= 0) {
+            return errno ? errno : EIO;
+        }
+        src += written;
+        length -= (size_t) written;
+    }
+    return 0;
+}
+
+static void* trace_writer(void* arg) {
+    HeapTrace* trace = (HeapTrace*) arg;
+    pthread_mutex_lock(&trace->mutex);
+    for (;;) {
+        while (trace->full == NULL && !trace->stopping) {
+            pthread_cond_wait(&trace->cond, &trace->mutex);
+        }
+        TraceBuffer* batch = trace->full;
+        if (batch == NULL) {
+            break;
+        }
+        trace->full = trace->full_tail = NULL;
+        pthread_mutex_unlock(&trace->mutex);
+        TraceBuffer* last = batch;
+        for (TraceBuffer* buffer = batch; buffer != NULL; buffer = buffer->next) {
+            if (!trace->write_error) {
+                trace->write_error = write_all(trace->fd, buffer->records, buffer->count * sizeof(TraceRecord));
+            }
+            buffer->count = 0;
+            last = buffer;
+        }
+        pthread_mutex_lock(&trace->mutex);
+        last->next = trace->spare;
+        trace->spare = batch;
+    }
+    pthread_mutex_unlock(&trace->mutex);
+    return NULL;
+}
+
+/* Queue a buffer for the writer, the caller must hold the trace mutex. */
+static void trace_queue_full(HeapTrace* trace, TraceBuffer* buffer) {
+    buffer->next = NULL;
+    if (trace->full_tail != NULL) {
+        trace->full_tail->next = buffer;
+    } else {
+        trace->full = buffer;
+    }
+    trace->full_tail = buffer;
+    pthread_cond_signal(&trace->cond);
+}
+
+/* Remove a buffer from the active list, the caller must hold the trace mutex. */
+static void trace_unlink_active(HeapTrace* trace, TraceBuffer* buffer) {
+    TraceBuffer** link = &trace->active;
+    while (*link != buffer) {
+        link = &(*link)->next;
+    }
+    *link = buffer->next;
+}
+
+/* Take a spare buffer or allocate one, the caller must hold the trace mutex. */
+static TraceBuffer* trace_buffer_new(HeapTrace* trace, uint32_t thread) {
+    TraceBuffer* buffer = trace->spare;
+    if (buffer != NULL) {
+        trace->spare = buffer->next;
+    } else if ((buffer = malloc(sizeof(*buffer))) == NULL) {
+        return NULL;
+    }
+    buffer->owner = pthread_self();
+    buffer->thread = thread;
+    buffer->count = 0;
+    buffer->next = trace->active;
+    trace->active = buffer;
+    return buffer;
+}
+
+/* Buffer with room for a record for the calling thread, NULL if none can be allocated. */
+static TraceBuffer* trace_buffer(HeapTrace* trace) {
+    TraceBuffer* buffer = trace_local_session == trace->session ? trace_local : NULL;
+    if (buffer != NULL && buffer->count < TRACE_BUFFER_RECORDS) {
+        return buffer;
+    }
+    pthread_mutex_lock(&trace->mutex);
+    if (buffer == NULL) {
+        /* The thread may be recording into several traces in turn. */
+        for (buffer = trace->active; buffer != NULL && !pthread_equal(buffer->owner, pthread_self()); buffer = buffer->next);
+    }
+    if (buffer == NULL) {
+        buffer = trace_buffer_new(trace, trace->threads++);
+    } else if (buffer->count == TRACE_BUFFER_RECORDS) {
+        trace_unlink_active(trace, buffer);
+        trace_queue_full(trace, buffer);
+        buffer = trace_buffer_new(trace, buffer->thread);
+    }
+    pthread_mutex_unlock(&trace->mutex);
+    trace_local = buffer;
+    trace_local_session = buffer != NULL ? trace->session : 0;
+    return buffer;
+}
+
+static uint8_t align_shift(size_t align) {
+    uint8_t shift = 0;
+    while (((size_t) 2 << shift) <= align) {
+        shift++;
+    }
+    return align ? shift : 0;
+}
+
+int trace_begin(Allocator* alloc) {
+    if (alloc == NULL || alloc->trace == NULL) {
+        return 0;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (alloc->trace == NULL) {
+        /* Stopped while waiting for the mutex. */
+        return __htfh_lock_unlock_handled(&alloc->mutex);
+    }
+    alloc->trace_depth++;
+    return 1;
+}
+
+void trace_end(Allocator* alloc, enum htfh_trace_op op, const void* ptr, const void* result, size_t size, size_t align) {
+    HeapTrace* trace = alloc->trace;
+    if (--alloc->trace_depth == 0 && op != TRACE_NONE) {
+        TraceBuffer* buffer = trace_buffer(trace);
+        if (buffer != NULL) {
+            TraceRecord* record = &buffer->records[buffer->count++];
+            record->seq = trace->seq++;
+            record->ptr = (uint64_t) (uintptr_t) ptr;
+            record->result = (uint64_t) (uintptr_t) result;
+            record->size = size;
+            record->thread = buffer->thread;
+            record->op = (uint8_t) op;
+            record->align_shift = align_shift(align);
+            record->reserved = 0;
+        } else {
+            trace->dropped++;
+        }
+    }
+    __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+int htfh_trace_start(Allocator* alloc, const char* path) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    }
+    HeapTrace* trace = malloc(sizeof(*trace));
+    if (trace == NULL) {
+        set_alloc_errno(MALLOC_FAILED);
+        return -1;
+    }
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace->fd == -1) {
+        set_alloc_errno_msg(TRACE_IO_FAILED, strerror(errno));
+        free(trace);
+        return -1;
+    }
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    int result = write_all(trace->fd, &header, sizeof(header));
+    if (result != 0) {
+        set_alloc_errno_msg(TRACE_IO_FAILED, strerror(result));
+        close(trace->fd);
+        free(trace);
+        return -1;
+    }
+    trace->alloc = alloc;
+    trace->session = __atomic_add_fetch(&trace_sessions, 1, __ATOMIC_RELAXED);
+    trace->seq = 0;
+    trace->threads = 0;
+    trace->active = trace->full = trace->full_tail = trace->spare = NULL;
+    trace->stopping = 0;
+    trace->write_error = 0;
+    trace->dropped = 0;
+    pthread_mutex_init(&trace->mutex, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        result = -1;
+    } else if (alloc->trace != NULL) {
+        set_alloc_errno(TRACE_ACTIVE);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        result = -1;
+    } else if ((result = pthread_create(&trace->writer, NULL, trace_writer, trace)) != 0) {
+        set_alloc_errno_msg(TRACE_IO_FAILED, strerror(result));
+        __htfh_lock_unlock_handled(&alloc->mutex);
+    } else {
+        alloc->trace = trace;
+        alloc->trace_depth = 0;
+        return __htfh_lock_unlock_handled(&alloc->mutex);
+    }
+    pthread_cond_destroy(&trace->cond);
+    pthread_mutex_destroy(&trace->mutex);
+    close(trace->fd);
+    free(trace);
+    return -1;
+}
+
+int htfh_trace_stop(Allocator* alloc) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    HeapTrace* trace = alloc->trace;
+    alloc->trace = NULL;
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (trace == NULL) {
+        set_alloc_errno(TRACE_NOT_ACTIVE);
+        return -1;
+    }
+    /* Nothing records once the trace is detached, hand over the partial buffers. */
+    pthread_mutex_lock(&trace->mutex);
+    while (trace->active != NULL) {
+        TraceBuffer* buffer = trace->active;
+        trace->active = buffer->next;
+        trace_queue_full(trace, buffer);
+    }
+    trace->stopping = 1;
+    pthread_cond_signal(&trace->cond);
+    pthread_mutex_unlock(&trace->mutex);
+    pthread_join(trace->writer, NULL);
+
+    int status = 0;
+    if (trace->write_error) {
+        set_alloc_errno_msg(TRACE_IO_FAILED, strerror(trace->write_error));
+        status = -1;
+    } else if (trace->dropped) {
+        set_alloc_errno(TRACE_RECORDS_DROPPED);
+        status = -1;
+    }
+    if (close(trace->fd) != 0 && status == 0) {
+        set_alloc_errno_msg(TRACE_IO_FAILED, strerror(errno));
+        status = -1;
+    }
+    while (trace->spare != NULL) {
+        TraceBuffer* buffer = trace->spare;
+        trace->spare = buffer->next;
+        free(buffer);
+    }
+    pthread_cond_destroy(&trace->cond);
+    pthread_mutex_destroy(&trace->mutex);
+    free(trace);
+    return status;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TRACE_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TRACE_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "htfh.h"
+
+/*
+** Allocation trace recorder.
+**
+** While a trace is active, every successful htfh_malloc_usable (and so
+** htfh_malloc and htfh_calloc), htfh_memalign, htfh_realloc and htfh_free
+** appends a fixed size record to a buffer owned by the calling thread.
+** Full buffers are handed to a writer thread that appends them to the
+** trace file, so recording never waits on I/O. Records are taken under
+** the allocator mutex and numbered in that order; calls made from within
+** another traced call, such as the malloc and free of a moving realloc,
+** are not recorded separately.
+**
+** Objects are identified by their address at the time of the call.
+** Blocks moved by htfh_compact or grown by htfh_try_expand
+** are not recorded, a replay skips frees of objects it does not know.
+**
+** The file starts with a TraceHeader followed by records in the order
+** buffers were flushed, sort them by seq to replay them.
+*/
+
+#define TRACE_MAGIC "HTFHTRC1"
+#define TRACE_VERSION 1
+
+/* Records held per thread buffer before it is handed to the writer. */
+#define TRACE_BUFFER_RECORDS 4096
+
+enum htfh_trace_op {
+    TRACE_NONE,
+    TRACE_MALLOC,
+    TRACE_FREE,
+    TRACE_REALLOC,
+    TRACE_MEMALIGN,
+};
+
+typedef struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} TraceHeader;
+
+typedef struct TraceRecord {
+    /* Position of the operation in the allocator's total order. */
+    uint64_t seq;
+    /* Pointer argument, 0 for malloc and memalign. */
+    uint64_t ptr;
+    /* Pointer returned, 0 for free and for a realloc to size 0. */
+    uint64_t result;
+    uint64_t size;
+    /* Thread number within the trace, in order of first operation. */
+    uint32_t thread;
+    uint8_t op;
+    /* log2 of the memalign alignment, 0 otherwise. */
+    uint8_t align_shift;
+    uint16_t reserved;
+} TraceRecord;
+
+typedef struct TraceBuffer {
+    /* Link in the active, full or spare list of the trace. */
+    struct TraceBuffer* next;
+    pthread_t owner;
+    uint32_t thread;
+    size_t count;
+    TraceRecord records[TRACE_BUFFER_RECORDS];
+} TraceBuffer;
+
+typedef struct HeapTrace {
+    Allocator* alloc;
+    int fd;
+    /* Unique across all traces, identifies the buffer cached by a thread. */
+    uint64_t session;
+    /* Next record number, guarded by the allocator mutex. */
+    uint64_t seq;
+    uint32_t threads;
+    /* Guards the buffer lists and wakes the writer. */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    TraceBuffer* active;
+    TraceBuffer* full;
+    TraceBuffer* full_tail;
+    TraceBuffer* spare;
+    pthread_t writer;
+    int stopping;
+    /* errno of the first failed write, further records are discarded. */
+    int write_error;
+    /* Records lost because no buffer could be allocated. */
+    size_t dropped;
+} HeapTrace;
+
+/* Start recording the allocator's operations into a new file at path. */
+int htfh_trace_start(Allocator* alloc, const char* path);
+/* Stop recording, flush every buffer and close the file. */
+int htfh_trace_stop(Allocator* alloc);
+
+/*
+** Bracket a traced allocator call. trace_begin returns 1 and holds the
+** allocator mutex if a trace is active, 0 if not and -1 on error. The
+** matching trace_end records op, unless it is TRACE_NONE or the call is
+** nested within another traced call, and releases the mutex.
+*/
+int trace_begin(Allocator* alloc);
+void trace_end(Allocator* alloc, enum htfh_trace_op op, const void* ptr, const void* result, size_t size, size_t align);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_TRACE_
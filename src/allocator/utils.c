@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <pthread.h>
 
 #if defined (__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4)) && defined (__GNUC_PATCHLEVEL__)
 inline int htfh_ffs(unsigned int word) {
@@ -71,7 +72,7 @@ void* align_ptr(const void* ptr, size_t align) {
     return (void*) aligned;
 }
 
-void mapping_insert(size_t size, int* fli, int* sli) {
+void mapping_insert_scan(size_t size, int* fli, int* sli) {
     if (size < SMALL_BLOCK_SIZE) {
         /* Store small blocks in first list. */
         *fli = 0;
@@ -84,9 +85,31 @@ void mapping_insert(size_t size, int* fli, int* sli) {
 }
 
 /* This version rounds up to the next block size (for allocations) */
-void mapping_search(size_t size, int* fli, int* sli) {
+void mapping_search_scan(size_t size, int* fli, int* sli) {
     if (size >= SMALL_BLOCK_SIZE) {
         size += (1 << (htfh_fls_sizet(size) - SL_INDEX_COUNT_LOG2)) - 1;
     }
-    mapping_insert(size, fli, sli);
-}
\ No newline at end of file
+    mapping_insert_scan(size, fli, sli);
+}
+
+MappingEntry mapping_insert_table[MAPPING_TABLE_COUNT];
+MappingEntry mapping_search_table[MAPPING_TABLE_COUNT];
+
+static pthread_once_t mapping_table_once = PTHREAD_ONCE_INIT;
+
+static void mapping_table_build(void) {
+    int fl;
+    int sl;
+    for (size_t i = 0; i < MAPPING_TABLE_COUNT; i++) {
+        mapping_insert_scan(i << ALIGN_SIZE_LOG2, &fl, &sl);
+        mapping_insert_table[i].fl = (unsigned char) fl;
+        mapping_insert_table[i].sl = (unsigned char) sl;
+        mapping_search_scan(i << ALIGN_SIZE_LOG2, &fl, &sl);
+        mapping_search_table[i].fl = (unsigned char) fl;
+        mapping_search_table[i].sl = (unsigned char) sl;
+    }
+}
+
+void mapping_table_init(void) {
+    pthread_once(&mapping_table_once, mapping_table_build);
+}
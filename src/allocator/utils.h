@@ -113,9 +113,53 @@ htfh_static_assert(ALIGN_SIZE == SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
 size_t align_up(size_t x, size_t align);
 size_t align_down(size_t x, size_t align);
 void* align_ptr(const void* ptr, size_t align);
-void mapping_insert(size_t size, int* fli, int* sli);
+/*
+** Size class lookup tables, filled once by mapping_table_init. The insert
+** table holds the class of each aligned size, the search table the class
+** a request of that size is rounded up to.
+*/
+typedef struct MappingEntry {
+    unsigned char fl;
+    unsigned char sl;
+} MappingEntry;
+
+extern MappingEntry mapping_insert_table[MAPPING_TABLE_COUNT];
+extern MappingEntry mapping_search_table[MAPPING_TABLE_COUNT];
+
+/* Build the lookup tables, safe to call repeatedly and from any thread. */
+void mapping_table_init(void);
+/* Compute the mapping with bit scans, used for sizes beyond the tables. */
+void mapping_insert_scan(size_t size, int* fli, int* sli);
+void mapping_search_scan(size_t size, int* fli, int* sli);
+
+static inline void mapping_insert(size_t size, int* fli, int* sli) {
+    if (size < MAPPING_TABLE_SIZE_MAX) {
+        const MappingEntry entry = mapping_insert_table[size >> ALIGN_SIZE_LOG2];
+        *fli = entry.fl;
+        *sli = entry.sl;
+        return;
+    }
+    mapping_insert_scan(size, fli, sli);
+}
+
 /* This version rounds up to the next block size (for allocations) */
-void mapping_search(size_t size, int* fli, int* sli);
+static inline void mapping_search(size_t size, int* fli, int* sli) {
+    if (size < SMALL_BLOCK_SIZE) {
+        /* Small sizes map linearly and are not rounded. */
+        mapping_insert(size, fli, sli);
+        return;
+    } else if (size <= MAPPING_TABLE_SIZE_MAX - ALIGN_SIZE) {
+        /*
+        ** Larger class bounds are multiples of ALIGN_SIZE, so rounding the
+        ** size up to it first does not change the class it rounds up to.
+        */
+        const MappingEntry entry = mapping_search_table[(size + ALIGN_SIZE - 1) >> ALIGN_SIZE_LOG2];
+        *fli = entry.fl;
+        *sli = entry.sl;
+        return;
+    }
+    mapping_search_scan(size, fli, sli);
+}
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,282 @@
+#include "verify.h"
+#include <unistd.h>
+
+static void verify_fault(HeapVerifier* verifier, const void* block, int fl, int sl, const char* reason) {
+    if (verifier->faulted) {
+        return;
+    }
+    verifier->faulted = 1;
+    verifier->fault.block = block;
+    verifier->fault.fl = fl;
+    verifier->fault.sl = sl;
+    verifier->fault.reason = reason;
+}
+
+static void default_fault_handler(const HeapFault* fault, void* user) {
+    (void) user;
+    fprintf(
+        stderr,
+        "Heap inconsistency at block %p (fl: %d, sl: %d): %s\n",
+        fault->block,
+        fault->fl,
+        fault->sl,
+        fault->reason
+    );
+}
+
+/* End of the pool currently walked by the cursor. */
+static const char* verify_pool_end(const HeapVerifier* verifier) {
+    const Allocator* alloc = verifier->alloc;
+    for (size_t i = 0; i < alloc->pool_count; i++) {
+        if (alloc->pools[i].start == verifier->cursor.pool) {
+            return alloc->pools[i].start + alloc->pools[i].bytes;
+        }
+    }
+    return verifier->cursor.pool;
+}
+
+/* Record a fault found by the physical walk, with the free list a free block belongs on. */
+static void verify_block_fault(HeapVerifier* verifier, const BlockHeader* block, const char* reason) {
+    int fl = -1;
+    int sl = -1;
+    if (block_is_free(block) && block_size(block) < block_size_max) {
+        mapping_insert(block_size(block), &fl, &sl);
+    }
+    verify_fault(verifier, block, fl, sl, reason);
+}
+
+/* Check a block against its physical neighbours, as integrity_walker does. */
+static void verify_block(void* ptr, size_t size, int used, void* user) {
+    HeapVerifier* verifier = (HeapVerifier*) user;
+    const BlockHeader* block = block_from_ptr(ptr);
+    (void) used;
+    if ((size % ALIGN_SIZE) != 0) {
+        verify_block_fault(verifier, block, "block size misaligned");
+        return;
+    } else if (size < block_size_min) {
+        verify_block_fault(verifier, block, "block not minimum size");
+        return;
+    } else if ((const char*) ptr + size + block_header_overhead > verify_pool_end(verifier)) {
+        verify_block_fault(verifier, block, "block extends beyond pool");
+        return;
+    }
+    const BlockHeader* next = block_next(block);
+    if (!block_is_prev_free(next) != !block_is_free(block)) {
+        verify_block_fault(verifier, next, "prev status incorrect");
+    } else if (block_is_free(block) && block_is_free(next)) {
+        verify_block_fault(verifier, block, "blocks should have coalesced");
+    } else if (block_is_free(block) && block_prev(next) != block) {
+        verify_block_fault(verifier, next, "previous physical block incorrect");
+    }
+}
+
+/* Check the physical layout of the next blocks, moving on to the free lists once done. */
+static void verify_physical(HeapVerifier* verifier, size_t budget) {
+    if (htfh_inspect_step(&verifier->cursor, budget, verify_block, verifier) != 0 || verifier->faulted) {
+        return;
+    }
+    verifier->phase = VERIFY_FREE_LISTS;
+    verifier->fl = 0;
+    verifier->sl = 0;
+    verifier->entry = NULL;
+    verifier->generation = verifier->alloc->controller->generation;
+}
+
+/* Check a list head against the bitmaps, as htfh_check does. */
+static void verify_list_head(HeapVerifier* verifier, const Controller* control, int fl, int sl) {
+    const BlockHeader* head = control->blocks[fl][sl];
+    const int fl_map = control->fl_bitmap & (1U << fl);
+    const int sl_map = control->sl_bitmap[fl] & (1U << sl);
+    if (!fl_map && sl_map) {
+        verify_fault(verifier, head, fl, sl, "second-level map must be null");
+    } else if (!sl_map && head != &control->block_null) {
+        verify_fault(verifier, head, fl, sl, "block list must be null");
+    } else if (sl_map && head == &control->block_null) {
+        verify_fault(verifier, head, fl, sl, "block should not be null");
+    }
+}
+
+/* Check a free list entry, as htfh_check does, and its links. */
+static void verify_entry(HeapVerifier* verifier, const Controller* control, const BlockHeader* block, int fl, int sl) {
+    int fli;
+    int sli;
+    const BlockHeader* prev = block_prev_free(block);
+    if (!block_is_free(block)) {
+        verify_fault(verifier, block, fl, sl, "block should be free");
+    } else if (block_is_prev_free(block)) {
+        verify_fault(verifier, block, fl, sl, "blocks should have coalesced");
+    } else if (block_is_free(block_next(block))) {
+        verify_fault(verifier, block, fl, sl, "blocks should have coalesced");
+    } else if (!block_is_prev_free(block_next(block))) {
+        verify_fault(verifier, block, fl, sl, "block should be free");
+    } else if (block_size(block) < block_size_min) {
+        verify_fault(verifier, block, fl, sl, "block not minimum size");
+    } else if (prev == &control->block_null ? control->blocks[fl][sl] != block : block_next_free(prev) != block) {
+        verify_fault(verifier, block, fl, sl, "free list links inconsistent");
+    } else {
+        mapping_insert(block_size(block), &fli, &sli);
+        if (fli != fl || sli != sl) {
+            verify_fault(verifier, block, fl, sl, "block size indexed in wrong list");
+        }
+    }
+}
+
+/* Nonzero if a saved entry is still a free block on the list being walked. */
+static int verify_entry_valid(const HeapVerifier* verifier, const Controller* control) {
+    int fl;
+    int sl;
+    if (verifier->entry == &control->block_null) {
+        return 1;
+    } else if (!controller_layout_valid(control, verifier->generation, verifier->entry)
+        || !block_is_free(verifier->entry)) {
+        return 0;
+    }
+    mapping_insert(block_size(verifier->entry), &fl, &sl);
+    return fl == verifier->fl && sl == verifier->sl;
+}
+
+static void verify_free_lists(HeapVerifier* verifier, size_t budget) {
+    const Controller* control = verifier->alloc->controller;
+    if (verifier->entry != NULL && !verify_entry_valid(verifier, control)) {
+        /* The entry was allocated or merged, check its list again from the head. */
+        verifier->entry = NULL;
+    }
+    while (budget > 0 && !verifier->faulted) {
+        if (verifier->entry == NULL) {
+            verify_list_head(verifier, control, verifier->fl, verifier->sl);
+            verifier->entry = control->blocks[verifier->fl][verifier->sl];
+            budget--;
+        } else if (verifier->entry != &control->block_null) {
+            verify_entry(verifier, control, verifier->entry, verifier->fl, verifier->sl);
+            verifier->entry = block_next_free(verifier->entry);
+            budget--;
+        } else if (++verifier->sl < SL_INDEX_COUNT) {
+            verifier->entry = NULL;
+        } else if (++verifier->fl < FL_INDEX_COUNT) {
+            verifier->sl = 0;
+            verifier->entry = NULL;
+        } else {
+            verifier->passes++;
+            verifier->phase = VERIFY_PHYSICAL;
+            htfh_inspect_begin(verifier->alloc, &verifier->cursor);
+            break;
+        }
+    }
+    verifier->generation = control->generation;
+}
+
+int htfh_verifier_init(HeapVerifier* verifier, Allocator* alloc, size_t budget, htfh_fault_handler handler, void* user) {
+    if (alloc == NULL) {
+        set_alloc_errno(NULL_ALLOCATOR_INSTANCE);
+        return -1;
+    } else if (verifier == NULL) {
+        set_alloc_errno(NULL_VERIFIER_INSTANCE);
+        return -1;
+    } else if (!budget) {
+        set_alloc_errno(INVALID_VERIFY_BUDGET);
+        return -1;
+    }
+    verifier->alloc = alloc;
+    verifier->budget = budget;
+    verifier->handler = handler != NULL ? handler : default_fault_handler;
+    verifier->user = user;
+    verifier->phase = VERIFY_PHYSICAL;
+    verifier->fl = 0;
+    verifier->sl = 0;
+    verifier->entry = NULL;
+    verifier->generation = 0;
+    verifier->passes = 0;
+    verifier->faulted = 0;
+    verifier->running = 0;
+    verifier->interval_us = 0;
+    return htfh_inspect_begin(alloc, &verifier->cursor);
+}
+
+int htfh_verify_step(HeapVerifier* verifier) {
+    if (verifier == NULL) {
+        set_alloc_errno(NULL_VERIFIER_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = verifier->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    } else if (verifier->faulted) {
+        set_alloc_errno_msg(HEAP_INCONSISTENT, verifier->fault.reason);
+        __htfh_lock_unlock_handled(&alloc->mutex);
+        return -1;
+    }
+    if (verifier->phase == VERIFY_PHYSICAL) {
+        verify_physical(verifier, verifier->budget);
+    } else {
+        verify_free_lists(verifier, verifier->budget);
+    }
+    const int faulted = verifier->faulted;
+    if (faulted) {
+        verifier->handler(&verifier->fault, verifier->user);
+        set_alloc_errno_msg(HEAP_INCONSISTENT, verifier->fault.reason);
+    }
+    if (__htfh_lock_unlock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    return faulted ? -1 : 0;
+}
+
+int htfh_verifier_attach(HeapVerifier* verifier, unsigned int every_n) {
+    if (verifier == NULL) {
+        set_alloc_errno(NULL_VERIFIER_INSTANCE);
+        return -1;
+    }
+    Allocator* alloc = verifier->alloc;
+    if (__htfh_lock_lock_handled(&alloc->mutex) != 0) {
+        return -1;
+    }
+    alloc->verifier = every_n ? verifier : NULL;
+    alloc->verify_every = every_n;
+    alloc->verify_countdown = every_n;
+    return __htfh_lock_unlock_handled(&alloc->mutex);
+}
+
+static void* verifier_thread(void* arg) {
+    HeapVerifier* verifier = (HeapVerifier*) arg;
+    while (verifier->running && htfh_verify_step(verifier) == 0) {
+        if (verifier->interval_us) {
+            usleep(verifier->interval_us);
+        }
+    }
+    return NULL;
+}
+
+int htfh_verifier_start(HeapVerifier* verifier, unsigned int interval_us) {
+    if (verifier == NULL) {
+        set_alloc_errno(NULL_VERIFIER_INSTANCE);
+        return -1;
+    } else if (verifier->running) {
+        set_alloc_errno(VERIFIER_RUNNING);
+        return -1;
+    }
+    verifier->interval_us = interval_us;
+    verifier->running = 1;
+    const int result = pthread_create(&verifier->thread, NULL, verifier_thread, verifier);
+    if (result != 0) {
+        verifier->running = 0;
+        set_alloc_errno_msg(VERIFIER_THREAD_FAILED, strerror(result));
+        return -1;
+    }
+    return 0;
+}
+
+int htfh_verifier_stop(HeapVerifier* verifier) {
+    if (verifier == NULL) {
+        set_alloc_errno(NULL_VERIFIER_INSTANCE);
+        return -1;
+    } else if (!verifier->running) {
+        return 0;
+    }
+    verifier->running = 0;
+    const int result = pthread_join(verifier->thread, NULL);
+    if (result != 0) {
+        set_alloc_errno_msg(VERIFIER_THREAD_FAILED, strerror(result));
+        return -1;
+    }
+    return 0;
+}
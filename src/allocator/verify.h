@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_VERIFY_
+#define _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_VERIFY_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <pthread.h>
+#include "htfh.h"
+#include "inspect.h"
+
+/*
+** Incremental heap integrity verifier.
+**
+** Each step checks at most budget blocks or free list entries under the
+** allocator mutex, so verification can run continuously at a bounded
+** cost. A pass first walks every pool physically with a HeapCursor,
+** checking the invariants of the integrity walker on each block against
+** its neighbours, then walks the free lists checking the bitmaps, links
+** and invariants of htfh_check. Passes repeat until an inconsistency is
+** found, which is recorded and reported to the fault handler once.
+** Entries changed while a pass is in progress may not be checked until
+** the next pass.
+**
+** Steps are driven by the caller, by a helper thread started with
+** htfh_verifier_start, or by the allocator itself on every Nth free once
+** attached with htfh_verifier_attach.
+*/
+
+typedef struct HeapFault {
+    /* Block header at which the check failed. */
+    const void* block;
+    /*
+    ** Free list being checked. During the physical walk, the list a free
+    ** block belongs on by its size, both -1 for a used block.
+    */
+    int fl;
+    int sl;
+    const char* reason;
+} HeapFault;
+
+/*
+** Called once with the first fault found. The handler runs with the
+** allocator mutex held, from whichever call ran the step: the caller of
+** htfh_verify_step, the helper thread, or htfh_free itself when the
+** verifier is attached. It must therefore not wait on other threads that
+** use the allocator, and any allocator call it makes modifies the heap
+** in the middle of the step.
+*/
+typedef void (*htfh_fault_handler)(const HeapFault* fault, void* user);
+
+enum htfh_verify_phase {
+    VERIFY_PHYSICAL,
+    VERIFY_FREE_LISTS,
+};
+
+typedef struct HeapVerifier {
+    Allocator* alloc;
+    /* Blocks or free list entries checked per step. */
+    size_t budget;
+    htfh_fault_handler handler;
+    void* user;
+    enum htfh_verify_phase phase;
+    HeapCursor cursor;
+    /* Free list being walked and the next entry to check, NULL for its head. */
+    int fl;
+    int sl;
+    BlockHeader* entry;
+    size_t generation;
+    /* Completed passes over the whole heap. */
+    size_t passes;
+    /* First inconsistency found, valid once faulted is set. */
+    int faulted;
+    HeapFault fault;
+    /* Helper thread, see htfh_verifier_start. */
+    pthread_t thread;
+    volatile int running;
+    unsigned int interval_us;
+} HeapVerifier;
+
+/*
+** Initialise a verifier, a NULL handler prints the fault to stderr. A
+** budget of 0 fails with INVALID_VERIFY_BUDGET.
+*/
+int htfh_verifier_init(HeapVerifier* verifier, Allocator* alloc, size_t budget, htfh_fault_handler handler, void* user);
+/*
+** Check the next budget blocks or entries. Returns 0 if no inconsistency
+** has been found and -1 with HEAP_INCONSISTENT, or another error, if one
+** has.
+*/
+int htfh_verify_step(HeapVerifier* verifier);
+
+/* Run a step from within every every_n-th free of the allocator, 0 detaches. */
+int htfh_verifier_attach(HeapVerifier* verifier, unsigned int every_n);
+/* Run steps from a helper thread, sleeping interval_us between them, until a fault or stop. */
+int htfh_verifier_start(HeapVerifier* verifier, unsigned int interval_us);
+int htfh_verifier_stop(HeapVerifier* verifier);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif // _C_HYBRID_TLSF_FIXED_HEAP_ALLOCATOR_VERIFY_
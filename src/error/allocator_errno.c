@@ -14,6 +14,10 @@ inline void get_alloc_errmsg(AllocatorErrno err) {
         enum_error(HEAP_ALREADY_MAPPED, "Managed heap has already been allocated")
         enum_error(HEAP_MMAP_FAILED, "Failed to map memory for heap")
         enum_error(HEAP_UNMAP_FAILED, "Failed to unmap anonymous memory for heap")
+        enum_error(HEAP_MADVISE_FAILED, "Failed to release heap pages")
+        enum_error(HEAP_MEMFD_FAILED, "Failed to create memfd backing for heap")
+        enum_error(HEAP_LOCK_FAILED, "Failed to lock heap into memory")
+        enum_error(HEAP_REALTIME, "Operation would make system calls on a realtime heap")
         enum_error(BAD_DEALLOC, "Unable to destruct Allocator instance")
         enum_error(MALLOC_FAILED, "Unable to reserve memory")
         enum_error(HEAP_MISALIGNED, "Heap size is not aligned correctly")
@@ -29,6 +33,7 @@ inline void get_alloc_errmsg(AllocatorErrno err) {
         enum_error(BLOCK_IS_NULL, "Block in context is null")
         enum_error(NON_ZERO_BLOCK_SIZE, "Block size must be non-zero")
         enum_error(BLOCK_NOT_FREE, "Block in context is not free")
+        enum_error(BLOCK_NOT_USED, "Block in context is not in use")
         enum_error(BLOCK_NOT_ALIGNED, "Block was not aligned correctly")
         enum_error(BLOCK_SIZE_MISMATCH, "Size of block in context did not match required structural size")
         enum_error(INVALID_BLOCK_SPLIT_SIZE, "Block was split with invalid size")
@@ -39,13 +44,61 @@ inline void get_alloc_errmsg(AllocatorErrno err) {
         enum_error(HEAP_FULL, "Cannot allocate, heap is full")
         enum_error(POOL_MISALIGNED, "Memory pool was not aligned correctly")
         enum_error(INVALID_POOL_SIZE, "Memory pool was of an invalid size")
+        enum_error(POOL_LIMIT_REACHED, "Maximum number of pools already registered")
+        enum_error(POOL_OVERLAP, "Memory pool overlaps a registered pool")
+        enum_error(POOL_NOT_FOUND, "Memory pool is not registered with this allocator")
+        enum_error(POOL_IN_USE, "Memory pool still holds allocated blocks")
+        enum_error(POOL_OUT_OF_RANGE, "Memory pool is too far from the controller for compact block headers")
         enum_error(FREE_NULL_PTR, "Attempted to free null pointer")
         enum_error(PTR_NOT_TO_BLOCK_HEADER, "Pointer does not point to a block header")
         enum_error(BLOCK_ALREADY_FREED, "Block was already freed")
         enum_error(MERGE_PREV_FAILED, "Unable to merge free block with previous")
         enum_error(MERGE_NEXT_FAILED, "Unable to merge free block with next")
         enum_error(CANNOT_REMOVE_BLOCK, "Unable to remove block")
+        enum_error(CANNOT_EXPAND_BLOCK, "Block cannot be expanded in place to the requested size")
         enum_error(GAP_TOO_SMALL, "Gap size is too small")
+        enum_error(BLOCK_MMAP_FAILED, "Failed to map memory for direct-mapped block")
+        enum_error(BLOCK_MREMAP_FAILED, "Failed to remap direct-mapped block")
+        enum_error(BLOCK_MUNMAP_FAILED, "Failed to unmap direct-mapped block")
+        enum_error(MAPPED_BLOCK_TOO_LARGE, "Direct-mapped block size exceeds the block header size field")
+        enum_error(NULL_ARENA_INSTANCE, "Arena is not initialised")
+        enum_error(INVALID_ARENA_MARK, "Arena mark does not belong to a live chunk")
+        enum_error(NULL_OBJPOOL_INSTANCE, "Object pool is not initialised")
+        enum_error(PTR_NOT_IN_OBJPOOL, "Pointer does not belong to this object pool")
+        enum_error(NULL_SNAPSHOT_INSTANCE, "Snapshot is not initialised")
+        enum_error(HEAP_NOT_SNAPSHOTTABLE, "Heap is not backed by a memfd and cannot be snapshotted")
+        enum_error(SNAPSHOT_ACTIVE, "A snapshot of the heap is already active")
+        enum_error(SNAPSHOT_MAP_FAILED, "Failed to remap heap for snapshot")
+        enum_error(NULL_HANDLE_TABLE_INSTANCE, "Handle table is not initialised")
+        enum_error(INVALID_HANDLE, "Handle does not refer to a live allocation")
+        enum_error(HANDLE_PINNED, "Handle is pinned")
+        enum_error(HANDLE_NOT_PINNED, "Handle is not pinned")
+        enum_error(NULL_WALKER, "Walker callback is not set")
+        enum_error(NULL_VERIFIER_INSTANCE, "Verifier is not initialised")
+        enum_error(HEAP_INCONSISTENT, "Heap integrity check failed")
+        enum_error(VERIFIER_RUNNING, "Verifier thread is already running")
+        enum_error(VERIFIER_THREAD_FAILED, "Failed to start or join verifier thread")
+        enum_error(ALLOC_TIMED_OUT, "Timed out waiting for heap space")
+        enum_error(CONDITION_INIT, "Failed to initialise condition variable")
+        enum_error(INVALID_TAG, "Allocation tag out of range")
+        enum_error(TAG_OVER_BUDGET, "Allocation would exceed the tag's byte budget")
+        enum_error(TRACE_ACTIVE, "Allocator is already being traced")
+        enum_error(TRACE_NOT_ACTIVE, "Allocator is not being traced")
+        enum_error(TRACE_IO_FAILED, "Failed to open or write trace file")
+        enum_error(TRACE_RECORDS_DROPPED, "Trace records were dropped for lack of buffer memory")
+        enum_error(NULL_IOSLICE_INSTANCE, "I/O slice is not initialised")
+        enum_error(IOSLICE_OUT_OF_RANGE, "Range lies outside the I/O slice")
+        enum_error(INVALID_IOVEC_COUNT, "Number of slices exceeds IOV_MAX")
+        enum_error(INVALID_WATERMARKS, "Low watermark exceeds high watermark")
+        enum_error(EPOCH_READER_ACTIVE, "Calling thread is inside an epoch read section")
+        enum_error(EPOCH_NOT_ENTERED, "Epoch exit without a matching enter")
+        enum_error(EPOCH_STATE_FAILED, "Unable to allocate epoch reclamation state")
+        enum_error(STATS_ACTIVE, "Allocator statistics are already published")
+        enum_error(STATS_NOT_ACTIVE, "Allocator statistics are not published")
+        enum_error(STATS_SEGMENT_FAILED, "Failed to create or map statistics segment")
+        enum_error(STATS_INVALID_SEGMENT, "Not an allocator statistics segment")
+        enum_error(STATS_SAMPLE_BUSY, "Statistics sample kept changing while being read")
+        enum_error(INVALID_VERIFY_BUDGET, "Verifier budget must be non-zero")
         enum_error(NONE, "")
         default: break;
     }
@@ -16,6 +16,10 @@ typedef enum allocator_error_num {
     HEAP_ALREADY_MAPPED,
     HEAP_MMAP_FAILED,
     HEAP_UNMAP_FAILED,
+    HEAP_MADVISE_FAILED,
+    HEAP_MEMFD_FAILED,
+    HEAP_LOCK_FAILED,
+    HEAP_REALTIME,
     BAD_DEALLOC,
     MALLOC_FAILED,
     HEAP_MISALIGNED,
@@ -33,11 +37,13 @@ typedef enum allocator_error_num {
     BLOCK_IS_NULL,
     NON_ZERO_BLOCK_SIZE,
     BLOCK_NOT_FREE,
+    BLOCK_NOT_USED,
     BLOCK_NOT_ALIGNED,
     BLOCK_SIZE_MISMATCH,
     INVALID_BLOCK_SPLIT_SIZE,
     BLOCK_ALREADY_FREED,
     CANNOT_REMOVE_BLOCK,
+    CANNOT_EXPAND_BLOCK,
 
     ALIGN_POWER_OF_TWO,
 
@@ -50,6 +56,11 @@ typedef enum allocator_error_num {
 
     POOL_MISALIGNED,
     INVALID_POOL_SIZE,
+    POOL_LIMIT_REACHED,
+    POOL_OVERLAP,
+    POOL_NOT_FOUND,
+    POOL_IN_USE,
+    POOL_OUT_OF_RANGE,
 
     FREE_NULL_PTR,
     PTR_NOT_TO_BLOCK_HEADER,
@@ -57,6 +68,62 @@ typedef enum allocator_error_num {
     MERGE_NEXT_FAILED,
 
     GAP_TOO_SMALL,
+
+    BLOCK_MMAP_FAILED,
+    BLOCK_MREMAP_FAILED,
+    BLOCK_MUNMAP_FAILED,
+    MAPPED_BLOCK_TOO_LARGE,
+
+    NULL_ARENA_INSTANCE,
+    INVALID_ARENA_MARK,
+
+    NULL_OBJPOOL_INSTANCE,
+    PTR_NOT_IN_OBJPOOL,
+
+    NULL_SNAPSHOT_INSTANCE,
+    HEAP_NOT_SNAPSHOTTABLE,
+    SNAPSHOT_ACTIVE,
+    SNAPSHOT_MAP_FAILED,
+
+    NULL_HANDLE_TABLE_INSTANCE,
+    INVALID_HANDLE,
+    HANDLE_PINNED,
+    HANDLE_NOT_PINNED,
+
+    NULL_WALKER,
+
+    NULL_VERIFIER_INSTANCE,
+    HEAP_INCONSISTENT,
+    VERIFIER_RUNNING,
+    VERIFIER_THREAD_FAILED,
+
+    ALLOC_TIMED_OUT,
+    CONDITION_INIT,
+
+    INVALID_TAG,
+    TAG_OVER_BUDGET,
+
+    TRACE_ACTIVE,
+    TRACE_NOT_ACTIVE,
+    TRACE_IO_FAILED,
+    TRACE_RECORDS_DROPPED,
+
+    NULL_IOSLICE_INSTANCE,
+    IOSLICE_OUT_OF_RANGE,
+    INVALID_IOVEC_COUNT,
+
+    INVALID_WATERMARKS,
+
+    EPOCH_READER_ACTIVE,
+    EPOCH_NOT_ENTERED,
+    EPOCH_STATE_FAILED,
+
+    STATS_ACTIVE,
+    STATS_NOT_ACTIVE,
+    STATS_SEGMENT_FAILED,
+    STATS_INVALID_SEGMENT,
+    STATS_SAMPLE_BUSY,
+    INVALID_VERIFY_BUDGET,
 } AllocatorErrno;
 
 
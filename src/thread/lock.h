@@ -9,14 +9,17 @@ extern "C" {
 
 #include <pthread.h>
 #include <sys/errno.h>
+#include <string.h>
+#include "../error/allocator_errno.h"
 
 typedef pthread_mutex_t __htfh_lock_t;
 
-#define __htfh_lock_init(lock, type) ({ \
+#define __htfh_lock_init_protocol(lock, type, protocol) ({ \
     int result = 0; \
     pthread_mutexattr_t attr; \
     if ((result = pthread_mutexattr_init(&attr)) == 0) { \
-        if ((result = pthread_mutexattr_settype(&attr, type)) == 0) { \
+        if ((result = pthread_mutexattr_settype(&attr, type)) == 0 \
+            && (result = pthread_mutexattr_setprotocol(&attr, protocol)) == 0) { \
             if ((result = pthread_mutex_init(lock, &attr)) == 0) { \
                 result = pthread_mutexattr_destroy(&attr) == EINVAL ? EINVAL : 0; \
             } \
@@ -25,8 +28,48 @@ typedef pthread_mutex_t __htfh_lock_t;
     result; \
 })
 
+#define __htfh_lock_init(lock, type) __htfh_lock_init_protocol(lock, type, PTHREAD_PRIO_NONE)
+
 #define __htfh_lock_lock(lock) pthread_mutex_lock(lock)
+#define __htfh_lock_trylock(lock) pthread_mutex_trylock(lock)
 #define __htfh_lock_unlock(lock) pthread_mutex_unlock(lock)
+#define __htfh_lock_destroy(lock) pthread_mutex_destroy(lock)
+
+/*
+** Locks taken through the handled macros and still held by the calling
+** thread, so that user callbacks can be deferred until none are held.
+*/
+extern __thread unsigned int __htfh_lock_depth;
+
+#define __htfh_lock_lock_handled(lock) ({ \
+    int _lock_result = __htfh_lock_lock(lock); \
+    if (_lock_result == EINVAL) { \
+        set_alloc_errno_msg(MUTEX_LOCK_LOCK, strerror(EINVAL)); \
+        _lock_result = -1; \
+    } else { \
+        __htfh_lock_depth += _lock_result == 0; \
+        _lock_result = 0; \
+    } \
+    _lock_result; \
+})
+
+/* Nonzero, without an allocator errno, if the lock is held elsewhere. */
+#define __htfh_lock_trylock_handled(lock) ({ \
+    const int _trylock_result = __htfh_lock_trylock(lock); \
+    __htfh_lock_depth += _trylock_result == 0; \
+    _trylock_result; \
+})
+
+#define __htfh_lock_unlock_handled(lock) ({ \
+    int _unlock_result = 0; \
+    if ((_unlock_result = __htfh_lock_unlock(lock)) != 0) { \
+        set_alloc_errno_msg(MUTEX_LOCK_UNLOCK, strerror(_unlock_result)); \
+        _unlock_result = -1; \
+    } else { \
+        __htfh_lock_depth--; \
+    } \
+    _unlock_result; \
+})
 
 #ifdef __cplusplus
 };